@@ -6,20 +6,82 @@ Documentation for the SMIS assembly language is hosted at https://github.com/Eye
 
 Program overview:
 
-    The assembling work is done in two passes.
+    The assembling work is done in a single pass over the source, followed by a backpatching step.
 
-    (Setup) The input .txt ASM file and the output .bin machine code file are opened.
+    (Setup) The whole input .txt ASM file is mapped into memory at once.
 
-    (Pass 1)
-        The ASM file is scanned for jump labels, which are placed into the symbol table.
-        Each symbol represents a name (to be checked against later for jump instructions),
+    (Pass)
+        Each line of the source is looked at once. Jump labels are placed into the symbol table,
+        where each symbol represents a name (to be checked against later for jump instructions)
         and the program counter address of the first actual instruction after the label.
-
-    (Pass 2)
-        Once the symbol table has been created, the second pass parses all instructions,
-        including their operands, into the binary file. Jump instruction labels are checked
-        against the symbol table, and if the label is found, they are assembled into their
-        corresponding label address. If a label does not exist, the file cannot be assembled.
+        Symbols are indexed by an open-addressing hash table, so looking a label up takes the
+        same time however many labels there are, and a label defined twice is an error.
+        All other lines are parsed, including their operands, into machine code in memory.
+        The first word of each instruction is looked up in a hash table of mnemonics, which gives
+        the opcode and the operand format, and the operands are then encoded by the format.
+        A jump to a label that has already been seen is assembled with the label address straight
+        away, and a jump to a label further down is recorded as a forward reference.
+
+    (Backpatching)
+        Once the whole source has been read, every forward reference is looked up in the symbol
+        table and its address is filled into the jump instruction. If a label does not exist,
+        the file cannot be assembled. The machine code is then written to the .bin file.
+
+    (Parallel) With -j <threads>, the source is split into one chunk of whole lines per thread, and
+        each thread runs the pass over its own chunk. Since a chunk cannot see the labels of the
+        others, every jump in it is recorded as a forward reference, and its labels are kept
+        aside with addresses counted from the start of the chunk. The chunks are then merged in
+        order: their labels go into the symbol table and their machine code and references are
+        moved up to where the chunk starts, after which backpatching works as above. If any chunk
+        has an error, the source is assembled again without threads so that the error is
+        reported just as it would be otherwise.
+
+    (Cache) With --cache, the results of a run are kept in a <output file>.cache file for the next run.
+        The source is split into blocks of whole lines, ending after lines whose hash matches a
+        pattern, so that a change only moves the ends of the blocks around it. Each block is then
+        assembled like a chunk above (all jumps as forward references, labels kept aside), and the
+        cache keeps the result of each block along with its text, indexed by the hash of the text.
+        On the next run, a block whose hash is found is compared with the text in the cache, and if
+        it is the same its result is taken from the cache without being parsed. Only the other
+        blocks are assembled (on several threads with -j). Since jumps are only filled in when the blocks are
+        merged, a block never depends on labels elsewhere, and moving labels around does not make
+        cached blocks stale. If the source, the options and the output file are all the same as
+        after the last run, nothing is assembled or written at all.
+        The cache file holds numbers in the byte order of the machine that wrote it:
+            "SMCA", version, source hash, output file size and modification time, options, block count,
+            for each block: hash, length, line count, instruction count, label count, fixup count,
+                the instructions, the labels and the fixups (each a position, line number and name),
+                the text of the block, padded to 8 bytes.
+
+    (Optimizing) With -O, the machine code is improved before it is written out. Instructions that do
+        nothing (COPY of a register to itself, and ADD-IMM of 0 to a register itself when the flags it
+        sets are overwritten before any jump can read them) are removed, as are jumps to the instruction
+        right after them. MULTIPLY-IMM and DIVIDE-IMM by a power of two become SHIFT-LEFT-IMM and
+        SHIFT-RIGHT-IMM, which give the same result and flags. A jump to a JUMP is sent straight to where
+        that JUMP goes. This is repeated until nothing changes, after which the remaining instructions
+        are moved up, and every label and jump is given its new address. A label at a removed
+        instruction ends up at the instruction after it, so the .sym file still lists every label.
+        In an object file, jumps to labels of other modules are not followed, since their target is
+        only known to smisld.
+
+    (Objects) If the output file ends in .obj instead of .bin, a relocatable object file is written,
+        so that a large program can be assembled one module at a time and put together by smisld.
+        Every jump is then kept as a reference: a jump to a label of the module is not filled in
+        but listed in the object with its label, and a jump to a label that the module does not
+        define is not an error but an import, which smisld looks up in the other modules. Label
+        addresses in an object count from the start of the module.
+        The format is (all numbers are 32-bit and big-endian, like the instructions):
+            "SMOB", version, instruction count, symbol count, relocation count, name bytes,
+            the instructions,
+            for each symbol: name offset, address (or OBJECT_IMPORT for a label the module uses but
+                does not define),
+            for each relocation: instruction number, symbol number,
+            the names, each ended by a null character.
+        Every label of the module is a symbol in definition order, followed by the imports.
+
+    (Symbols) With --symbols, the symbol table is also written to a .sym file next to the
+        .bin file, one "<address> <label>" line per label, so that tools such as the emulator's
+        profiler can refer to addresses by label.
 
 */
 
@@ -33,12 +95,46 @@ Program overview:
 #include <stdint.h>
 #include <stdbool.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
-#define USAGE "Usage: ./smisasm <input .txt ASM file> <output .bin executable file>\n"
+#define USAGE "Usage: ./smisasm [--symbols] [--quiet] [--cache] [-O] [-j <threads>] <input .txt ASM file> <output .bin executable or .obj object file>\n"
 #define MAX_INSTRUCTION_LEN 50
 #define MAX_STRING_LEN 500
 #define INT_LIMIT 65535
+#define MAX_THREADS 256
+#define MAX_OPTIMIZE_PASSES 16
+
+#define OBJECT_MAGIC "SMOB"
+#define OBJECT_VERSION 1
+#define OBJECT_IMPORT 0xFFFFFFFF
+
+#define CACHE_MAGIC "SMCA"
+#define CACHE_VERSION 2
+#define CACHE_BLOCK_MIN_LINES 16
+#define CACHE_BLOCK_MAX_LINES 1024
+#define CACHE_BLOCK_PATTERN 0x3F
+// A block ends after a line whose hash has none of these bits set, which happens about every 64 lines
+#define CACHE_INDEX_MIN_SLOTS 1024
+
+#define FNV64_OFFSET 0xCBF29CE484222325ULL
+#define FNV64_PRIME 0x00000100000001B3ULL
+#define MAX_LINE_WORDS (MAX_INSTRUCTION_LEN / 2 + 1)
+// Words are separated by exactly one space, so a line of MAX_INSTRUCTION_LEN - 1 characters has at most this many
+
+#define MNEMONIC_SLOTS 128
+// Comfortably more than twice the number of mnemonics, so that most lookups find the mnemonic in the first slot
+
+#define SYMBOL_INDEX_MIN_SLOTS 1024
+#define LABEL_ARENA_BLOCK 0x10000
+// The hash index is kept at most half full and doubles when it would go over, label names are copied into large
+// blocks that are never moved or freed one by one
 
 #define OP_SET              1
 #define OP_COPY             2
@@ -87,43 +183,308 @@ Program overview:
 #define OP_HALT             36
 // TODO: Possibly add exit code to HALT?
 
+#define FORMAT_REGISTER     0
+#define FORMAT_IMMEDIATE    1
+#define FORMAT_JUMP         2
+#define FORMAT_SET          3
+#define FORMAT_COPY         4
+#define FORMAT_COMPARE      5
+#define FORMAT_COMPARE_IMM  6
+#define FORMAT_HALT         7
+
+
+typedef struct Token {
+
+    char* start;
+    uint32_t len;
+
+} Token;
+// A word of the source, pointing into the source buffer rather than being copied out of it
+
+typedef struct Line {
+
+    char* text;
+    Token words[MAX_LINE_WORDS];
+    int wordCount;
+
+} Line;
+
+typedef enum OperandType { OPERAND_REGISTER, OPERAND_IMMEDIATE, OPERAND_LABEL } OperandType;
+
+typedef struct InstructionFormat {
+
+    int operandCount;
+    OperandType operands[3];
+    uint8_t shifts[3];
+
+} InstructionFormat;
+// The operands an instruction takes, and where each of them goes in the assembled instruction
+
+typedef struct Mnemonic {
+
+    char* name;
+    uint8_t opcode;
+    uint8_t format;
+
+} Mnemonic;
 
 typedef struct Label {
 
     char* labelName;
     uint16_t PCAddress;
+    uint32_t lineNumber;
+    bool imported;
 
 } Label;
 
+typedef struct Fixup {
+
+    Token labelName;
+    uint32_t instructionIndex;
+    uint32_t lineNumber;
+
+} Fixup;
+
+typedef struct Chunk {
+
+    char* start;
+    size_t len;
+    uint64_t hash;
+    char* text;
+
+    uint32_t* code;
+    uint32_t codeCount;
+    Fixup* fixups;
+    uint32_t fixupCount;
+    Label* labels;
+    uint32_t labelCount;
+    uint32_t labelCapacity;
+    uint32_t lineCount;
+
+    bool done;
+    bool failed;
+
+} Chunk;
+// A part of the source assembled on its own, with addresses, positions and line numbers counted from its start
+
+typedef struct ChunkQueue {
+
+    Chunk* chunks;
+    uint32_t count;
+    atomic_uint next;
+
+} ChunkQueue;
+
+typedef struct CacheHeader {
+
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t outputSize;
+    int64_t outputTime;
+    uint32_t options;
+    uint32_t blockCount;
+
+} CacheHeader;
+
+typedef struct CacheBlock {
+
+    uint64_t hash;
+    uint64_t len;
+    uint32_t lineCount;
+    uint32_t codeCount;
+    uint32_t labelCount;
+    uint32_t fixupCount;
+
+} CacheBlock;
+// Followed by the instructions, then a CacheName for each label and each fixup, then the text of the block
+
+typedef struct CacheName {
+
+    uint32_t position;
+    uint32_t lineNumber;
+    char name[MAX_INSTRUCTION_LEN];
+
+} CacheName;
+// The address of a label or the instruction number of a fixup, with the line it is at and its label name
+
+typedef struct Cache {
+
+    uint8_t* contents;
+    size_t size;
+    CacheBlock** blocks;
+    uint32_t* index;
+    uint32_t indexSlots;
+
+} Cache;
+// A cache file read into memory, with a hash table of positions in blocks plus 1 by block hash
+
+
+const InstructionFormat FORMATS[] = {
+
+    [FORMAT_REGISTER]       = { 3, { OPERAND_REGISTER, OPERAND_REGISTER, OPERAND_REGISTER }, { 20, 16, 12 } },
+    [FORMAT_IMMEDIATE]      = { 3, { OPERAND_REGISTER, OPERAND_REGISTER, OPERAND_IMMEDIATE }, { 20, 16, 0 } },
+    [FORMAT_JUMP]           = { 1, { OPERAND_LABEL }, { 0 } },
+    [FORMAT_SET]            = { 2, { OPERAND_REGISTER, OPERAND_IMMEDIATE }, { 20, 0 } },
+    [FORMAT_COPY]           = { 2, { OPERAND_REGISTER, OPERAND_REGISTER }, { 20, 16 } },
+    [FORMAT_COMPARE]        = { 2, { OPERAND_REGISTER, OPERAND_REGISTER }, { 16, 12 } },
+    [FORMAT_COMPARE_IMM]    = { 2, { OPERAND_REGISTER, OPERAND_IMMEDIATE }, { 16, 0 } },
+    [FORMAT_HALT]           = { 0 }
+
+};
+
+const Mnemonic MNEMONICS[] = {
+
+    { "SET", OP_SET, FORMAT_SET },
+    { "COPY", OP_COPY, FORMAT_COPY },
+
+    { "ADD", OP_ADD, FORMAT_REGISTER },
+    { "SUBTRACT", OP_SUBTRACT, FORMAT_REGISTER },
+    { "MULTIPLY", OP_MULTIPLY, FORMAT_REGISTER },
+    { "DIVIDE", OP_DIVIDE, FORMAT_REGISTER },
+    { "MODULO", OP_MODULO, FORMAT_REGISTER },
+
+    { "COMPARE", OP_COMPARE, FORMAT_COMPARE },
+
+    { "SHIFT-LEFT", OP_SHIFT_LEFT, FORMAT_REGISTER },
+    { "SHIFT-RIGHT", OP_SHIFT_RIGHT, FORMAT_REGISTER },
+
+    { "AND", OP_AND, FORMAT_REGISTER },
+    { "OR", OP_OR, FORMAT_REGISTER },
+    { "XOR", OP_XOR, FORMAT_REGISTER },
+    { "NAND", OP_NAND, FORMAT_REGISTER },
+    { "NOR", OP_NOR, FORMAT_REGISTER },
+    { "NOT", OP_NOT, FORMAT_COPY },
+
+    { "ADD-IMM", OP_ADD_IMM, FORMAT_IMMEDIATE },
+    { "SUBTRACT-IMM", OP_SUBTRACT_IMM, FORMAT_IMMEDIATE },
+    { "MULTIPLY-IMM", OP_MULTIPLY_IMM, FORMAT_IMMEDIATE },
+    { "DIVIDE-IMM", OP_DIVIDE_IMM, FORMAT_IMMEDIATE },
+    { "MODULO-IMM", OP_MODULO_IMM, FORMAT_IMMEDIATE },
+
+    { "COMPARE-IMM", OP_COMPARE_IMM, FORMAT_COMPARE_IMM },
+    { "SHIFT-LEFT-IMM", OP_SHIFT_LEFT_IMM, FORMAT_IMMEDIATE },
+    { "SHIFT-RIGHT-IMM", OP_SHIFT_RIGHT_IMM, FORMAT_IMMEDIATE },
+    { "AND-IMM", OP_AND_IMM, FORMAT_IMMEDIATE },
+    { "OR-IMM", OP_OR_IMM, FORMAT_IMMEDIATE },
+    { "XOR-IMM", OP_XOR_IMM, FORMAT_IMMEDIATE },
+    { "NAND-IMM", OP_NAND_IMM, FORMAT_IMMEDIATE },
+    { "NOR-IMM", OP_NOR_IMM, FORMAT_IMMEDIATE },
+
+    { "LOAD", OP_LOAD, FORMAT_IMMEDIATE },
+    { "STORE", OP_STORE, FORMAT_IMMEDIATE },
+
+    { "JUMP", OP_JUMP, FORMAT_JUMP },
+    { "JUMP-IF-ZERO", OP_JUMP_IF_ZERO, FORMAT_JUMP },
+    { "JUMP-IF-NOTZERO", OP_JUMP_IF_NOTZERO, FORMAT_JUMP },
+    { "JUMP-LINK", OP_JUMP_LINK, FORMAT_JUMP },
+
+    { "HALT", OP_HALT, FORMAT_HALT }
+
+};
+
+uint8_t MNEMONIC_INDEX[MNEMONIC_SLOTS];
+// Hash table of positions in MNEMONICS plus 1, with 0 marking an empty slot
 
 Label* SYMBOL_TABLE;
-// Stores all labels in the assembled file
+// Stores all labels in the assembled file, in the order they were defined
 uint32_t SYMBOL_COUNT = 0;
 // Stores the amount of symbols to avoid iterating over unallocated pointers
+uint32_t SYMBOL_CAPACITY = 0;
 
-uint16_t INSTRUCTION_ADDR = 0;
-// Instruction address is stored for symbol table usage
-uint32_t LINE_NUMBER = 1;
-// Line number is stored in order to give more descriptive error messages
+uint32_t* SYMBOL_INDEX = NULL;
+uint32_t SYMBOL_INDEX_SLOTS = 0;
+// Hash table of positions in SYMBOL_TABLE plus 1, with 0 marking an empty slot
 
+char* LABEL_ARENA = NULL;
+size_t LABEL_ARENA_LEFT = 0;
+// The unused end of the current block of label names
+char* LABEL_BLOCKS = NULL;
+// The newest block of label names, each block starting with a pointer to the one before it
 
-void readLabels(char* readfile);
-void readInstructions(char* readfile, char* writefile);
+bool OBJECT_OUTPUT = false;
+// Whether a relocatable .obj file is written instead of a .bin file
+
+bool SOURCE_MAPPED = false;
+// Whether the source buffer is a mapping of the file or a copy of it
+
+_Thread_local uint32_t* CODE = NULL;
+_Thread_local uint32_t CODE_COUNT = 0;
+_Thread_local uint32_t CODE_CAPACITY = 0;
+// Stores the assembled instructions until the whole source has been read
+
+_Thread_local Fixup* FIXUPS = NULL;
+_Thread_local uint32_t FIXUP_COUNT = 0;
+_Thread_local uint32_t FIXUP_CAPACITY = 0;
+// Stores jumps to labels that had not been defined yet when the jump was assembled
+
+_Thread_local uint16_t INSTRUCTION_ADDR = 0;
+// Instruction address is stored for symbol table usage
+_Thread_local uint32_t LINE_NUMBER = 1;
+// Line number is stored in order to give more descriptive error messages
+_Thread_local Chunk* CHUNK = NULL;
+// The chunk being assembled by this thread, or NULL when assembling the whole source
+_Thread_local jmp_buf CHUNK_ERROR;
+// Where assembleChunk() goes back to when its chunk has an error
+// The pass state above is per thread, so that each thread assembles its chunk exactly as the whole source would be
+
+
+char* readSource(char* readfile, size_t* len);
+void freeSource(char* source, size_t len);
+void assembleSource(char* source, size_t len);
+Chunk* splitEvenly(char* source, size_t len, uint32_t count);
+bool assembleChunks(Chunk* chunks, uint32_t count, int threads);
+void* chunkWorker(void* queue);
+void assembleChunk(Chunk* chunk);
+void mergeChunks(Chunk* chunks, uint32_t count);
+void freeChunks(Chunk* chunks, uint32_t count);
+void abandonChunk();
+void patchFixups();
+void optimizeCode();
+bool areFlagsLive(bool* removed, uint32_t index);
+uint32_t getNextKept(bool* removed, uint32_t index);
+void writeBinary(char* writefile, bool echo);
+void writeObject(char* writefile, bool echo);
+void printListing();
+void writeSymbols(char* binfile);
 uint32_t assembleInstruction(char* instruction);
+void emitInstruction(uint32_t instruction);
+void addFixup(Token lbl);
 // Program control functions
 
-uint32_t RType(char* instruction);
-uint32_t IType(char* instruction);
-uint32_t JType(char* instruction);
-uint32_t SType(char* instruction);
+Chunk* splitBlocks(char* source, size_t len, uint32_t* count, uint64_t* sourceHash);
+bool loadCache(char* cachefile, Cache* cache);
+void freeCache(Cache* cache);
+bool isUpToDate(Cache* cache, uint64_t sourceHash, uint32_t options, char* writefile);
+void reuseBlocks(Chunk* chunks, uint32_t count, Cache* cache);
+void writeCache(char* cachefile, Chunk* chunks, uint32_t count, uint64_t sourceHash, uint32_t options, char* writefile);
+size_t getCacheBlockSize(CacheBlock* block);
+char* getCacheBlockText(CacheBlock* block);
+// Cache functions
+
+void initMnemonics();
+const Mnemonic* findMnemonic(Token word);
+uint32_t encodeOperand(Line* line, int arg, OperandType type, uint8_t shift);
 // Instruction assembly functions
 
-uint16_t getLabelAddr(char* lbl);
-uint8_t getRegisterNum(char* str);
-uint16_t getImmediateVal(char* str);
-bool fitsRegisterSyntax(char* str);
-bool fitsImmediateSyntax(char* str);
-int countArgs(char* instruction);//
+void addLabel(char* lbl, uint16_t addr, uint32_t line);
+void addChunkLabel(char* lbl);
+void addImport(Token lbl);
+int32_t findLabel(Token lbl);
+void growSymbolIndex();
+uint32_t hashWord(Token word);
+char* copyLabelName(char* lbl);
+void freeLabelNames();
+// Symbol table functions
+
+uint16_t getLabelAddr(Token lbl);
+uint8_t getRegisterNum(Token word);
+uint16_t getImmediateVal(Token word);
+uint32_t getWordNum(Token word);
+bool fitsRegisterSyntax(Token word);
+bool fitsImmediateSyntax(Token word);
+void splitLine(char* instruction, Line* line);
+void checkArgCount(Line* line, int count);
 bool isBlankLineOrComment(char* str);//
 bool isLabel(char* str);//
 // Assembler utility functions
@@ -131,9 +492,8 @@ bool isLabel(char* str);//
 void trimLineBreak(char* str);//
 void trimLabelColon(char* str);//
 void trimChar(char* str, char c);//
-bool containsOnlyNums(char* str);//
-char* getFirstWord(char* str);//
-char* getWord(char* str, int w);//
+bool containsOnlyNums(char* str, uint32_t len);//
+bool wordIs(Token word, char* str);
 char* getBinary(uint32_t n, int length);
 unsigned char binaryChar(uint8_t n);
 bool endsWith(char* str, char* substr);//
@@ -142,7 +502,13 @@ bool endsWith(char* str, char* substr);//
 
 int main(int argc, char** argv) {
 
-    if(argc != 3) {
+    bool symbols = false;
+    bool quiet = false;
+    bool cache = false;
+    bool optimize = false;
+    int threads = 1;
+
+    if(argc < 3) {
 
         printf("Incorrect number of arguments supplied.\n");
         printf(USAGE);
@@ -150,7 +516,34 @@ int main(int argc, char** argv) {
 
     }
 
-    if(!endsWith(argv[1], ".txt") || !endsWith(argv[2], ".bin")) {
+    for(int arg = 1; arg < argc - 2; arg++) {
+
+        if(!strncmp(argv[arg], "--symbols", MAX_STRING_LEN)) symbols = true;
+        else if(!strncmp(argv[arg], "--quiet", MAX_STRING_LEN)) quiet = true;
+        else if(!strncmp(argv[arg], "--cache", MAX_STRING_LEN)) cache = true;
+        else if(!strncmp(argv[arg], "-O", MAX_STRING_LEN)) optimize = true;
+        else if(!strncmp(argv[arg], "-j", MAX_STRING_LEN) && arg + 1 < argc - 2
+            && containsOnlyNums(argv[arg + 1], strnlen(argv[arg + 1], MAX_STRING_LEN))
+            && strtol(argv[arg + 1], NULL, 10) > 0 && strtol(argv[arg + 1], NULL, 10) <= MAX_THREADS) {
+
+            threads = strtol(argv[++arg], NULL, 10);
+
+        } else {
+
+            printf("Unknown or repeated argument %s.\n", argv[arg]);
+            printf(USAGE);
+            exit(-1);
+
+        }
+
+    }
+
+    char* readfile = argv[argc - 2];
+    char* writefile = argv[argc - 1];
+
+    OBJECT_OUTPUT = endsWith(writefile, ".obj");
+
+    if(!endsWith(readfile, ".txt") || (!endsWith(writefile, ".bin") && !OBJECT_OUTPUT)) {
 
         printf("One or both of the supplied files have incorrect extensions.\n");
         printf(USAGE);
@@ -160,506 +553,531 @@ int main(int argc, char** argv) {
 
     SYMBOL_TABLE = NULL;
 
-    readLabels(argv[1]);
-    readInstructions(argv[1], argv[2]);
+    initMnemonics();
 
-    free(SYMBOL_TABLE);
+    size_t len;
+    char* source = readSource(readfile, &len);
 
-}
+    char cachefile[MAX_STRING_LEN];
+    snprintf(cachefile, MAX_STRING_LEN, "%s.cache", writefile);
 
-void readLabels(char* readfile) {
-    // Reads all jump labels into the symbol table for use in assembling jump instructions
+    Cache previous = { 0 };
+    uint64_t sourceHash = 0;
+    uint32_t options = OBJECT_OUTPUT | symbols << 1 | optimize << 2;
 
-    FILE* asmFile;
+    Chunk* chunks = NULL;
+    uint32_t chunkCount = 0;
+    char* original = NULL;
 
-    if(!(asmFile = fopen(readfile, "r"))) {
+    if(cache) {
 
-        printf("File %s does not exist.\n", readfile);
-        printf(USAGE);
-        exit(-1);
+        chunks = splitBlocks(source, len, &chunkCount, &sourceHash);
+        original = readSource(readfile, &len);
 
-    }
+        for(uint32_t i = 0; i < chunkCount; i++) chunks[i].text = original + (chunks[i].start - source);
+        // Assembling ends the lines of the source in place, so the text that goes into the cache is kept apart
 
-    char* line = malloc(MAX_INSTRUCTION_LEN * sizeof(char));
+        if(loadCache(cachefile, &previous) && isUpToDate(&previous, sourceHash, options, writefile)) {
 
-    while(fgets(line, MAX_INSTRUCTION_LEN, asmFile)) {
+            if(!quiet) printf("%s is up to date\n", writefile);
 
-        if(isBlankLineOrComment(line)) continue;
+            freeChunks(chunks, chunkCount);
+            freeCache(&previous);
+            freeSource(original, len);
+            freeSource(source, len);
+            return 0;
 
-        if(isLabel(line)) {
+        }
 
-            trimLabelColon(line);
+        reuseBlocks(chunks, chunkCount, &previous);
 
-            Label l;
-            l.labelName = strndup(line, MAX_INSTRUCTION_LEN);
-            l.PCAddress = INSTRUCTION_ADDR;
+    } else if(threads > 1) {
 
-            SYMBOL_TABLE = realloc(SYMBOL_TABLE, (SYMBOL_COUNT + 1) * sizeof(Label));
+        chunkCount = threads;
+        chunks = splitEvenly(source, len, chunkCount);
 
-            SYMBOL_TABLE[SYMBOL_COUNT] = l;
-            
-            SYMBOL_COUNT++;
+    }
+
+    if(chunks && assembleChunks(chunks, chunkCount, threads)) mergeChunks(chunks, chunkCount);
+    else {
+
+        if(chunks) {
+
+            freeSource(source, len);
+            source = readSource(readfile, &len);
 
-        } else INSTRUCTION_ADDR += 2;
+        }
+        // The chunks have ended their lines in place, so a fresh copy of the source is needed
+        // A chunk only fails on an error, which this reports
+
+        assembleSource(source, len);
 
     }
 
-    fclose(asmFile);
-    free(line);
+    if(!OBJECT_OUTPUT) patchFixups();
+    if(optimize) optimizeCode();
 
-}
+    if(OBJECT_OUTPUT) writeObject(writefile, !quiet);
+    else writeBinary(writefile, !quiet);
 
-void readInstructions(char* readfile, char* writefile) {
-    // Reads all instructions from the given file and interprets them
+    if(symbols) writeSymbols(writefile);
+    if(cache) writeCache(cachefile, chunks, chunkCount, sourceHash, options, writefile);
 
-    FILE* asmFile;
-    FILE* binFile;
+    free(SYMBOL_TABLE);
+    free(SYMBOL_INDEX);
+    freeLabelNames();
+    free(CODE);
+    free(FIXUPS);
+    freeChunks(chunks, chunkCount);
+    freeCache(&previous);
+    if(original) freeSource(original, len);
+    freeSource(source, len);
 
-    if(!(asmFile = fopen(readfile, "r"))) {
+}
 
-        printf("File %s does not exist.\n", readfile);
-        printf(USAGE);
-        exit(-1);
+char* readSource(char* readfile, size_t* len) {
+    // Maps the whole ASM file into memory so that it only has to be read once
+    // Lines are ended in place, so the mapping is private and writable, and a file that does not end in a line break
+    // is copied instead so that there is room to end its last line
 
-    }
+    int asmFile;
+    struct stat info;
 
-    if(!(binFile = fopen(writefile, "wb"))) {
+    if((asmFile = open(readfile, O_RDONLY)) < 0 || fstat(asmFile, &info) || !S_ISREG(info.st_mode)) {
 
-        printf("Cannot output to file %s.\n", writefile);
+        printf("File %s does not exist.\n", readfile);
         printf(USAGE);
         exit(-1);
 
     }
 
-    char* instruction = malloc(MAX_INSTRUCTION_LEN * sizeof(char));
+    char* source = MAP_FAILED;
+    *len = info.st_size;
 
-    while(fgets(instruction, MAX_INSTRUCTION_LEN, asmFile)) {
+    if(*len) source = mmap(NULL, *len, PROT_READ | PROT_WRITE, MAP_PRIVATE, asmFile, 0);
 
-        bool skipLine = false;
+    SOURCE_MAPPED = source != MAP_FAILED && source[*len - 1] == '\n';
 
-        if(isBlankLineOrComment(instruction) || isLabel(instruction)) skipLine = true;
-        // Skip line breaks and comments
+    if(!SOURCE_MAPPED) {
 
-        if(!skipLine) {
-            
-            int lineBreakIndex = strnlen(instruction, MAX_INSTRUCTION_LEN) - 1;
-            if(instruction[lineBreakIndex] == '\n') instruction[lineBreakIndex] = '\0';
-            // Remove any trailing line breaks from the instruction
+        if(source != MAP_FAILED) munmap(source, *len);
 
-            uint32_t buffer = htonl(assembleInstruction(instruction));
+        source = malloc(*len + 1);
 
-            printf("%.8X\n", ntohl(buffer));
+        if(pread(asmFile, source, *len, 0) != (ssize_t) *len) {
 
-            fwrite(&buffer, sizeof(uint32_t), 1, binFile);
+            printf("Cannot read file %s.\n", readfile);
+            exit(-1);
 
         }
 
-        LINE_NUMBER++;
+        source[*len] = '\0';
 
     }
 
-    fclose(asmFile);
-    fclose(binFile);
-    free(instruction);
+    close(asmFile);
+
+    return source;
 
 }
 
-uint32_t assembleInstruction(char* instruction) {
-    // Assembles all instruction types into their respective numeric values
+void freeSource(char* source, size_t len) {
+    // Unmaps or frees the source buffer, whichever readSource() made
 
-    uint32_t instructionNum = 0;
+    if(SOURCE_MAPPED) munmap(source, len);
+    else free(source);
 
-    if((instructionNum = RType(instruction))) return instructionNum;
-    else if((instructionNum = IType(instruction))) return instructionNum;
-    else if((instructionNum = JType(instruction))) return instructionNum;
-    else if((instructionNum = SType(instruction))) return instructionNum;
+}
 
-    else {
+void assembleSource(char* source, size_t len) {
+    // Goes through the source once, adding labels to the symbol table and assembling all instructions
+    // Each line is ended in place, so the buffer must stay around until the forward references have been patched
 
-        printf("Invalid instruction at line %i\n", LINE_NUMBER);
-        printf("Instruction: %s\n", instruction);
+    char* line = source;
+    char* end = source + len;
 
-        exit(-1);
+    while(line < end) {
 
-    }
+        char* lineEnd = memchr(line, '\n', end - line);
+        if(!lineEnd) lineEnd = end;
 
-}
+        *lineEnd = '\0';
 
-uint32_t RType(char* instruction) {
-    // Assembles all basic R-type (register) instructions, excluding COPY, COMPARE, and NOT
-    // Returns 0 if the given string is not a valid R-type instruction
+        if(!isBlankLineOrComment(line)) {
 
-    uint32_t instructionNum = 0;
+            if(lineEnd - line >= MAX_INSTRUCTION_LEN) {
 
-    char* opcodeStr = getFirstWord(instruction);
-    uint8_t opcodeNum;
+                abandonChunk();
+                printf("Line %i is longer than %i characters\n", LINE_NUMBER, MAX_INSTRUCTION_LEN - 1);
+                exit(-1);
 
-    if(!strncmp(opcodeStr, "ADD", 4)) opcodeNum = OP_ADD;
-    else if(!strncmp(opcodeStr, "SUBTRACT", 9)) opcodeNum = OP_SUBTRACT;
-    else if(!strncmp(opcodeStr, "MULTIPLY", 9)) opcodeNum = OP_MULTIPLY;
-    else if(!strncmp(opcodeStr, "DIVIDE", 7)) opcodeNum = OP_DIVIDE;
-    else if(!strncmp(opcodeStr, "MODULO", 7)) opcodeNum = OP_MODULO;
+            }
 
-    else if(!strncmp(opcodeStr, "SHIFT-LEFT", 11)) opcodeNum = OP_SHIFT_LEFT;
-    else if(!strncmp(opcodeStr, "SHIFT-RIGHT", 12)) opcodeNum = OP_SHIFT_RIGHT;
+            if(isLabel(line)) {
 
-    else if(!strncmp(opcodeStr, "AND", 4)) opcodeNum = OP_AND;
-    else if(!strncmp(opcodeStr, "OR", 3)) opcodeNum = OP_OR;
-    else if(!strncmp(opcodeStr, "XOR", 4)) opcodeNum = OP_XOR;
-    else if(!strncmp(opcodeStr, "NAND", 5)) opcodeNum = OP_NAND;
-    else if(!strncmp(opcodeStr, "NOR", 4)) opcodeNum = OP_NOR;
+                trimLabelColon(line);
 
-    else return 0;
+                if(CHUNK) addChunkLabel(line);
+                else addLabel(line, INSTRUCTION_ADDR, LINE_NUMBER);
 
-    instructionNum += opcodeNum << 24;
+            } else {
 
-    if(countArgs(instruction) != 4) {
+                emitInstruction(assembleInstruction(line));
+                INSTRUCTION_ADDR += 2;
 
-        printf("Incorrect number of arguments at line %i\n", LINE_NUMBER);
-        printf("Instruction: %s\n", instruction);
-        exit(-1);
+            }
+
+        }
+
+        line = lineEnd + 1;
+        LINE_NUMBER++;
 
     }
 
-    for(int arg = 1; arg <= 3; arg++) {
-        
-        if(!fitsRegisterSyntax(getWord(instruction, arg))) {
+}
 
-            printf("Wrong format of argument %i at line %i\n", arg, LINE_NUMBER);
-            printf("Instruction: %s\n", instruction);
-            exit(-1);
+Chunk* splitEvenly(char* source, size_t len, uint32_t count) {
+    // Splits the source into a given number of chunks of whole lines and about the same size, for -j
 
-        }
+    Chunk* chunks = calloc(count, sizeof(Chunk));
 
-    }
+    char* end = source + len;
+    char* chunkStart = source;
 
-    uint8_t rDest = getRegisterNum(getWord(instruction, 1));
-    uint8_t rOp1 = getRegisterNum(getWord(instruction, 2));
-    uint8_t rOp2 = getRegisterNum(getWord(instruction, 3));
+    for(uint32_t i = 0; i < count; i++) {
 
-    instructionNum += rDest << 20;
-    instructionNum += rOp1 << 16;
-    instructionNum += rOp2 << 12;
+        char* chunkEnd = i == count - 1 ? end : source + len * (i + 1) / count;
 
-    return instructionNum;
+        if(chunkEnd <= chunkStart) chunkEnd = chunkStart;
+        else if(chunkEnd < end) {
 
-}
+            char* lineEnd = memchr(chunkEnd, '\n', end - chunkEnd);
+            chunkEnd = lineEnd ? lineEnd + 1 : end;
 
-uint32_t IType(char* instruction) {
-    // Assembles all basic I-type (immediate) instructions, excluding SET and COMPARE-IMM
-    // Returns 0 if the given string is not a valid I-type instruction
+        }
+        // Each chunk ends just after a line break, so no line is split between two chunks
 
-    uint32_t instructionNum = 0;
+        chunks[i].start = chunkStart;
+        chunks[i].len = chunkEnd - chunkStart;
+        chunkStart = chunkEnd;
 
-    char* opcodeStr = getFirstWord(instruction);
-    uint8_t opcodeNum;
+    }
 
-    if(!strncmp(opcodeStr, "ADD-IMM", 8)) opcodeNum = OP_ADD_IMM;
-    else if(!strncmp(opcodeStr, "SUBTRACT-IMM", 13)) opcodeNum = OP_SUBTRACT_IMM;
-    else if(!strncmp(opcodeStr, "MULTIPLY-IMM", 13)) opcodeNum = OP_MULTIPLY_IMM;
-    else if(!strncmp(opcodeStr, "DIVIDE-IMM", 11)) opcodeNum = OP_DIVIDE_IMM;
-    else if(!strncmp(opcodeStr, "MODULO-IMM", 11)) opcodeNum = OP_MODULO_IMM;
+    return chunks;
 
-    else if(!strncmp(opcodeStr, "SHIFT-LEFT-IMM", 15)) opcodeNum = OP_SHIFT_LEFT_IMM;
-    else if(!strncmp(opcodeStr, "SHIFT-RIGHT-IMM", 16)) opcodeNum = OP_SHIFT_RIGHT_IMM;
+}
 
-    else if(!strncmp(opcodeStr, "AND-IMM", 8)) opcodeNum = OP_AND_IMM;
-    else if(!strncmp(opcodeStr, "OR-IMM", 7)) opcodeNum = OP_OR_IMM;
-    else if(!strncmp(opcodeStr, "XOR-IMM", 8)) opcodeNum = OP_XOR_IMM;
-    else if(!strncmp(opcodeStr, "NAND-IMM", 9)) opcodeNum = OP_NAND_IMM;
-    else if(!strncmp(opcodeStr, "NOR-IMM", 8)) opcodeNum = OP_NOR_IMM;
-    else if(!strncmp(opcodeStr, "LOAD", 5)) opcodeNum = OP_LOAD;
-    else if(!strncmp(opcodeStr, "STORE", 6)) opcodeNum = OP_STORE;
+bool assembleChunks(Chunk* chunks, uint32_t count, int threads) {
+    // Assembles every chunk that is not done yet, on the given number of threads
+    // Returns false if any chunk has an error
 
-    else return 0;
+    ChunkQueue queue = { .chunks = chunks, .count = count };
 
-    instructionNum += opcodeNum << 24;
+    if(threads == 1) chunkWorker(&queue);
+    else {
 
-    if(countArgs(instruction) != 4) {
+        pthread_t* workers = malloc(threads * sizeof(pthread_t));
 
-        printf("Incorrect number of arguments at line %i\n", LINE_NUMBER);
-        printf("Instruction: %s\n", instruction);
-        exit(-1);
+        for(int i = 0; i < threads; i++) pthread_create(&workers[i], NULL, chunkWorker, &queue);
+        for(int i = 0; i < threads; i++) pthread_join(workers[i], NULL);
+
+        free(workers);
 
     }
 
-    for(int arg = 1; arg <= 3; arg++) {
-        
-        if((arg != 3 && !fitsRegisterSyntax(getWord(instruction, arg)))
-            || (arg == 3 && !fitsImmediateSyntax(getWord(instruction, arg)))) {
+    for(uint32_t i = 0; i < count; i++) if(chunks[i].failed) return false;
 
-            printf("Wrong format of argument %i at line %i\n", arg, LINE_NUMBER);
-            printf("Instruction: %s\n", instruction);
-            exit(-1);
+    return true;
 
-        }
+}
 
-    }
+void* chunkWorker(void* queue) {
+    // Takes the next chunk that is not done yet from the queue and assembles it, until there are none left
 
-    uint8_t rDest = getRegisterNum(getWord(instruction, 1));
-    uint8_t rOp1 = getRegisterNum(getWord(instruction, 2));
-    uint16_t iOp2 = getImmediateVal(getWord(instruction, 3));
+    ChunkQueue* q = queue;
+    uint32_t i;
 
-    instructionNum += rDest << 20;
-    instructionNum += rOp1 << 16;
-    instructionNum += iOp2;
+    while((i = atomic_fetch_add(&q->next, 1)) < q->count) if(!q->chunks[i].done) assembleChunk(&q->chunks[i]);
 
-    return instructionNum;
+    return NULL;
 
 }
 
-uint32_t JType(char* instruction) {
-    // Assembles all basic J-type (jump) instructions
-    // Returns 0 if the given string is not a valid J-type instruction
+void assembleChunk(Chunk* chunk) {
+    // Assembles one chunk of the source with fresh pass state, and hands the results over to the chunk
 
-    uint32_t instructionNum = 0;
+    CHUNK = chunk;
+    CODE = NULL;
+    CODE_COUNT = CODE_CAPACITY = 0;
+    FIXUPS = NULL;
+    FIXUP_COUNT = FIXUP_CAPACITY = 0;
+    INSTRUCTION_ADDR = 0;
+    LINE_NUMBER = 1;
 
-    char* opcodeStr = getFirstWord(instruction);
-    uint8_t opcodeNum;
+    if(!setjmp(CHUNK_ERROR)) {
 
-    if(!strncmp(opcodeStr, "JUMP", 5)) opcodeNum = OP_JUMP;
-    else if(!strncmp(opcodeStr, "JUMP-IF-ZERO", 13)) opcodeNum = OP_JUMP_IF_ZERO;
-    else if(!strncmp(opcodeStr, "JUMP-IF-NOTZERO", 16)) opcodeNum = OP_JUMP_IF_NOTZERO;
-    else if(!strncmp(opcodeStr, "JUMP-LINK", 10)) opcodeNum = OP_JUMP_LINK;
+        assembleSource(chunk->start, chunk->len);
 
-    else return 0;
+        chunk->code = CODE;
+        chunk->codeCount = CODE_COUNT;
+        chunk->fixups = FIXUPS;
+        chunk->fixupCount = FIXUP_COUNT;
+        chunk->lineCount = LINE_NUMBER - 1;
+        chunk->done = true;
 
-    instructionNum += opcodeNum << 24;
+    } else {
 
-    if(countArgs(instruction) != 2) {
+        chunk->failed = true;
 
-        printf("Incorrect number of arguments at line %i\n", LINE_NUMBER);
-        printf("Instruction: %s\n", instruction);
-        exit(-1);
+        free(CODE);
+        free(FIXUPS);
 
     }
 
-    uint16_t destAddr = getLabelAddr(getWord(instruction, 1));
-
-    instructionNum += destAddr;
-
-    return instructionNum;
+    CHUNK = NULL;
+    CODE = NULL;
+    CODE_COUNT = CODE_CAPACITY = 0;
+    FIXUPS = NULL;
+    FIXUP_COUNT = FIXUP_CAPACITY = 0;
+    INSTRUCTION_ADDR = 0;
+    LINE_NUMBER = 1;
 
 }
 
-uint32_t SType(char* instruction) {
-    // Assembles all non-standard instructions
-    // Returns 0 if the given string is not a valid special instruction
+void mergeChunks(Chunk* chunks, uint32_t count) {
+    // Puts the labels of all chunks into the symbol table and joins their machine code and forward references, in order
+    // Labels are added in source order, so a label defined twice is reported at the same line as without chunks
 
-    uint32_t instructionNum = 0;
+    uint32_t codeCount = 0;
+    uint32_t fixupCount = 0;
 
-    char* opcodeStr = getFirstWord(instruction);
-    uint8_t opcodeNum;
+    for(uint32_t i = 0; i < count; i++) {
 
-    bool immediateMode = false;
-    bool compareMode = false;
-    bool rDestMode = false;
-    
-    if(!strncmp(opcodeStr, "HALT", 5)) return OP_HALT << 24;
-    else if(!strncmp(opcodeStr, "SET", 4)) { opcodeNum = OP_SET; immediateMode = true; }
-    else if(!strncmp(opcodeStr, "COPY", 5)) { opcodeNum = OP_COPY; rDestMode = true; }
-    else if(!strncmp(opcodeStr, "COMPARE", 8)) { opcodeNum = OP_COMPARE; compareMode = true; }
-    else if(!strncmp(opcodeStr, "COMPARE-IMM", 12)) { opcodeNum = OP_COMPARE_IMM; immediateMode = true; compareMode = true;}
-    else if(!strncmp(opcodeStr, "NOT", 4)) { opcodeNum = OP_NOT; rDestMode = true; }
+        codeCount += chunks[i].codeCount;
+        fixupCount += chunks[i].fixupCount;
 
-    else return 0;
+    }
 
-    instructionNum += opcodeNum << 24;
+    CODE_CAPACITY = codeCount;
+    CODE = malloc(codeCount * sizeof(uint32_t));
+    FIXUP_CAPACITY = fixupCount;
+    FIXUPS = malloc(fixupCount * sizeof(Fixup));
 
-    if(countArgs(instruction) != 3) {
+    uint32_t firstLine = 1;
 
-        printf("Incorrect number of arguments at line %i\n", LINE_NUMBER);
-        printf("Instruction: %s\n", instruction);
-        exit(-1);
+    for(uint32_t i = 0; i < count; i++) {
 
-    }
+        Chunk* c = &chunks[i];
+        uint16_t firstAddr = CODE_COUNT * 2;
 
-    for(int arg = 1; arg <= 2; arg++) {
-        
-        if((arg == 1 && !fitsRegisterSyntax(getWord(instruction, arg)))
-            || (arg == 2 && !immediateMode && !fitsRegisterSyntax(getWord(instruction, arg)))
-            || (arg == 2 && immediateMode && !fitsImmediateSyntax(getWord(instruction, arg)))) {
+        for(uint32_t l = 0; l < c->labelCount; l++) {
 
-            printf("Wrong format of argument %i at line %i\n", arg, LINE_NUMBER);
-            printf("Instruction: %s\n", instruction);
-            exit(-1);
+            Label label = c->labels[l];
+            addLabel(label.labelName, firstAddr + label.PCAddress, firstLine + label.lineNumber - 1);
 
         }
 
-    }
+        for(uint32_t f = 0; f < c->fixupCount; f++) {
 
-    uint8_t reg = getRegisterNum(getWord(instruction, 1));
-    uint16_t op = immediateMode ? getImmediateVal(getWord(instruction, 2)) : getRegisterNum(getWord(instruction, 2));
+            Fixup fixup = c->fixups[f];
 
-    if(compareMode) instructionNum += reg << 16;
-    else instructionNum += reg << 20;
-    if(immediateMode) instructionNum += op;
-    else if(rDestMode) instructionNum += op << 16;
-    else instructionNum += op << 12;
+            fixup.instructionIndex += CODE_COUNT;
+            fixup.lineNumber += firstLine - 1;
 
-    return instructionNum;
+            FIXUPS[FIXUP_COUNT++] = fixup;
 
-}
+        }
 
-uint16_t getLabelAddr(char* lbl) {
-    // Reads the symbol table and finds a corresponding label address, terminating the program if none is found
+        memcpy(CODE + CODE_COUNT, c->code, c->codeCount * sizeof(uint32_t));
 
-    for(int i = 0; i < SYMBOL_COUNT; i++) {
+        CODE_COUNT += c->codeCount;
+        firstLine += c->lineCount;
 
-        Label l = SYMBOL_TABLE[i];
+    }
+
+}
+
+void freeChunks(Chunk* chunks, uint32_t count) {
+    // Frees all chunks along with their results
 
-        if(!strncmp(l.labelName, lbl, MAX_INSTRUCTION_LEN)) return l.PCAddress;
+    for(uint32_t i = 0; i < count; i++) {
+
+        free(chunks[i].code);
+        free(chunks[i].fixups);
+        free(chunks[i].labels);
 
     }
 
-    printf("Cannot use label %s at line %i because it does not exist in the symbol table\n", lbl, LINE_NUMBER);
-    exit(-1);
+    free(chunks);
 
 }
 
-uint8_t getRegisterNum(char* str) {
-    // Gets the register address from a given string
-    // Assumes that string has already been validated as a proper register address argument
+void abandonChunk() {
+    // Stops assembling a chunk that has an error, without reporting the error
+    // The source is assembled again as a whole afterwards, which reports it
 
-    if(!strncmp(str, "RZR", MAX_STRING_LEN)) return 0;
-    else if(!strncmp(str, "RSP", MAX_STRING_LEN)) return 15;
-    else if(!strncmp(str, "RBP", MAX_STRING_LEN)) return 14;
-    else if(!strncmp(str, "RLR", MAX_STRING_LEN)) return 13;
+    if(!CHUNK) return;
 
-    return strtol(str + 1, NULL, 10);
+    longjmp(CHUNK_ERROR, 1);
 
 }
 
-uint16_t getImmediateVal(char* str) {
-    // Gets the immediate value from a given string
-    // Assumes that string has already been validated as a proper immediate argument
+void patchFixups() {
+    // Fills in the addresses of all jumps to labels that were defined after the jump
 
-    return strtol(str + 1, NULL, 10);
+    for(uint32_t i = 0; i < FIXUP_COUNT; i++) {
+
+        LINE_NUMBER = FIXUPS[i].lineNumber;
+        CODE[FIXUPS[i].instructionIndex] += getLabelAddr(FIXUPS[i].labelName);
+
+    }
 
 }
 
-bool fitsRegisterSyntax(char* str) {
-    // Checks if a given string fits the SMIS register standard syntax "R<4-bit unsigned register address>"
+void optimizeCode() {
+    // Rewrites instructions into cheaper ones and removes the ones that have no effect, then gives every label and
+    // jump its new address
+    // Jumps are followed by the instruction number they go to, which is -1 for a jump to a label of another module
 
-    if(*str != 'R') return false;
+    int32_t* targets = malloc((CODE_COUNT + 1) * sizeof(int32_t));
+    int32_t* fixupOf = malloc((CODE_COUNT + 1) * sizeof(int32_t));
+    uint32_t* newIndex = malloc((CODE_COUNT + 1) * sizeof(uint32_t));
+    bool* removed = calloc(CODE_COUNT + 1, sizeof(bool));
 
-    if(!strncmp(str, "RZR", MAX_STRING_LEN)) return true;
-    else if(!strncmp(str, "RSP", MAX_STRING_LEN)) return true;
-    else if(!strncmp(str, "RBP", MAX_STRING_LEN)) return true;
-    else if(!strncmp(str, "RLR", MAX_STRING_LEN)) return true;
+    for(uint32_t i = 0; i < CODE_COUNT; i++) {
 
-    if(!containsOnlyNums(str + 1)) return false;
+        uint8_t opcode = CODE[i] >> 24;
+        uint16_t imm = CODE[i] & 0xFFFF;
 
-    uint8_t regNum = strtol(str + 1, NULL, 10);
-    if(regNum > 15) return false;
+        targets[i] = opcode >= OP_JUMP && opcode <= OP_JUMP_LINK && !OBJECT_OUTPUT ? imm / 2 : -1;
+        fixupOf[i] = -1;
 
-    return true;
+        if((opcode == OP_MULTIPLY_IMM || opcode == OP_DIVIDE_IMM) && imm && !(imm & (imm - 1))) {
 
-}
+            uint16_t shift = 0;
 
-bool fitsImmediateSyntax(char* str) {
-    // Checks if a given string fits the SMIS immediate standard syntax "#<16-bit unsigned int>"
+            while(1 << shift != imm) shift++;
 
-    if(*str != '#') return false;
+            CODE[i] = (opcode == OP_MULTIPLY_IMM ? OP_SHIFT_LEFT_IMM : OP_SHIFT_RIGHT_IMM) << 24 | (CODE[i] & 0x00FF0000) | shift;
 
-    if(!containsOnlyNums(str + 1)) return false;
+        }
+        // Registers hold 16-bit unsigned values, so both give exactly the same result and flags
 
-    uint16_t immVal = strtol(str + 1, NULL, 10);
-    if(immVal > INT_LIMIT) return false;
+    }
 
-    return true;
+    if(OBJECT_OUTPUT) {
 
-}
+        for(uint32_t f = 0; f < FIXUP_COUNT; f++) {
 
-int countArgs(char* instruction) {
-    // Counts the number of space-separated arguments in a given instruction
+            int32_t label = findLabel(FIXUPS[f].labelName);
 
-    char* originalInstruction = instruction;
+            fixupOf[FIXUPS[f].instructionIndex] = f;
+            targets[FIXUPS[f].instructionIndex] = label >= 0 ? SYMBOL_TABLE[label].PCAddress / 2 : -1;
 
-    int count = 0;
-    bool lastCharWasSpace = false;
+        }
 
-    while(*instruction) {
+    }
+    // Every jump in an object is a fixup, and the labels that are not in the symbol table yet are imports
 
-        if(!lastCharWasSpace && *instruction == ' ') { lastCharWasSpace = true; count++; }
-        else if(*instruction != ' ') lastCharWasSpace = false;
-        else {
+    bool changed = true;
 
-            printf("Incorrect spacing at line %i\n", LINE_NUMBER);
-            printf("Instruction: %s\n", originalInstruction);
-            exit(-1);
+    for(int pass = 0; changed && pass < MAX_OPTIMIZE_PASSES; pass++) {
 
-        }
+        changed = false;
 
-        instruction++;
+        for(uint32_t i = 0; i < CODE_COUNT; i++) {
 
-    }
+            if(removed[i]) continue;
 
-    count++;
+            uint8_t opcode = CODE[i] >> 24;
+            uint8_t dest = CODE[i] >> 20 & 0xF;
+            uint8_t src = CODE[i] >> 16 & 0xF;
+            uint32_t next = getNextKept(removed, i + 1);
 
-    return count;
+            if((opcode == OP_COPY && dest == src)
+                || (opcode == OP_ADD_IMM && dest == src && !(CODE[i] & 0xFFFF) && !areFlagsLive(removed, next))
+                || (opcode >= OP_JUMP && opcode <= OP_JUMP_IF_NOTZERO && targets[i] >= 0 && getNextKept(removed, targets[i]) == next)) {
 
-}
+                removed[i] = true;
+                changed = true;
+                continue;
 
-bool isBlankLineOrComment(char* str) {
-    // Checks a line of the ASM file to see if it should be skipped
+            }
+            // A JUMP-LINK to the next instruction still sets the link register, so it is kept
 
-    if(!strncmp(str, "\n", 2) || !strncmp(str, "//", 2)) return true;
+            if(opcode < OP_JUMP || opcode > OP_JUMP_LINK || targets[i] < 0) continue;
 
-    return false;
+            uint32_t target = getNextKept(removed, targets[i]);
 
-}
+            if(target == i || target >= CODE_COUNT || CODE[target] >> 24 != OP_JUMP || targets[target] == targets[i]) continue;
 
-bool isLabel(char* str) {
-    // Checks if a given line ends with a ':', denoting that it is a jump label
+            targets[i] = targets[target];
+            if(OBJECT_OUTPUT) FIXUPS[fixupOf[i]].labelName = FIXUPS[fixupOf[target]].labelName;
+            changed = true;
+            // Jumps that go around in a loop keep being sent on until the passes run out, and end up on one of the
+            // jumps in the loop, which loops just the same
 
-    trimLineBreak(str);
-    int len = strnlen(str, MAX_STRING_LEN) - 1;
+        }
 
-    return str[len] == ':';
+    }
 
-}
+    uint32_t kept = 0;
 
-void trimLineBreak(char* str) {
-    // Trims a trailing line break from a given string
+    for(uint32_t i = 0; i <= CODE_COUNT; i++) {
 
-    trimChar(str, '\n');
+        newIndex[i] = kept;
+        if(i < CODE_COUNT && !removed[i]) kept++;
 
-}
+    }
+    // A removed instruction gets the new number of the next instruction that is kept
 
-void trimLabelColon(char* str) {
-    // Trims a trailing colon from a given string
+    for(uint32_t i = 0; i < CODE_COUNT; i++) {
 
-    trimChar(str, ':');
+        if(removed[i]) continue;
 
-}
+        if(targets[i] >= 0 && !OBJECT_OUTPUT) CODE[newIndex[i]] = (CODE[i] & 0xFFFF0000) | newIndex[targets[i]] * 2;
+        else CODE[newIndex[i]] = CODE[i];
 
-void trimChar(char* str, char c) {
-    // Trims the first instance of a given character from the end of a given string
-    // If the string does not contain the character, it remains unchanged
+    }
 
-    int len = strnlen(str, MAX_STRING_LEN);
+    uint32_t fixupCount = 0;
 
-    for(int i = len; i >= 0; i--) {
-        
-        if(str[i] == c) {
-            
-            str[i] = '\0';
-            return;
+    for(uint32_t f = 0; f < FIXUP_COUNT && OBJECT_OUTPUT; f++) {
 
-        }
+        if(removed[FIXUPS[f].instructionIndex]) continue;
+
+        FIXUPS[f].instructionIndex = newIndex[FIXUPS[f].instructionIndex];
+        FIXUPS[fixupCount++] = FIXUPS[f];
 
     }
 
+    if(OBJECT_OUTPUT) FIXUP_COUNT = fixupCount;
+
+    for(uint32_t l = 0; l < SYMBOL_COUNT; l++) SYMBOL_TABLE[l].PCAddress = newIndex[SYMBOL_TABLE[l].PCAddress / 2] * 2;
+
+    CODE_COUNT = kept;
+
+    free(targets);
+    free(fixupOf);
+    free(newIndex);
+    free(removed);
+
 }
 
-bool containsOnlyNums(char* str) {
-    // Checks if a given string contains only numerical digit characters
+bool areFlagsLive(bool* removed, uint32_t index) {
+    // Checks if the flags as they are before an instruction might still be read, by following the code from there
+    // until an instruction sets the flags again
+    // Any jump, HALT or the end of the code counts as reading them, and so does a division that may stop the program
+
+    for(uint32_t i = index; i < CODE_COUNT; i++) {
+
+        if(removed[i]) continue;
 
-    while(*str) {
+        uint8_t opcode = CODE[i] >> 24;
 
-        if(*str < '0' || *str > '9') return false;
-        str++;
+        if(opcode >= OP_JUMP || opcode == OP_DIVIDE || opcode == OP_MODULO) return true;
+        if((opcode == OP_DIVIDE_IMM || opcode == OP_MODULO_IMM) && !(CODE[i] & 0xFFFF)) return true;
+        if(opcode >= OP_ADD && opcode <= OP_NOR_IMM) return false;
 
     }
 
@@ -667,49 +1085,921 @@ bool containsOnlyNums(char* str) {
 
 }
 
-char* getFirstWord(char* str) {
-    // Gets the first word (all characters before first space or null terminator) from a given string
+uint32_t getNextKept(bool* removed, uint32_t index) {
+    // Gets the first instruction from the given one on that has not been removed, or CODE_COUNT if there is none
 
-    int strlen = strnlen(str, MAX_STRING_LEN) + 1;
+    while(index < CODE_COUNT && removed[index]) index++;
 
-    char* word = malloc(strlen * sizeof(char));
+    return index;
 
-    int i = 0;
-    
-    while(*str && *str != ' ') {
+}
 
-        word[i] = *str;
-        str++;
-        i++;
+Chunk* splitBlocks(char* source, size_t len, uint32_t* count, uint64_t* sourceHash) {
+    // Splits the source into blocks of whole lines for the cache, and gets the hash of each block and of the source
+    // Where a block ends only depends on the lines just before, so a change to the source only changes the blocks
+    // around it
 
-    }
+    uint32_t capacity = 256;
+    Chunk* chunks = malloc(capacity * sizeof(Chunk));
 
-    word[i] = '\0';
+    char* end = source + len;
+    char* c = source;
 
-    int wordlen = strnlen(word, MAX_STRING_LEN) + 1;
-    word = realloc(word, wordlen * sizeof(char));
+    *count = 0;
+    *sourceHash = FNV64_OFFSET;
 
-    return word;
+    while(c < end) {
 
-}
+        char* blockStart = c;
+        uint64_t blockHash = FNV64_OFFSET;
+        uint32_t lines = 0;
 
-char* getWord(char* str, int w) {
-    // Gets an indexed word from a given string
+        while(c < end) {
 
-    if(w >= countArgs(str)) {
+            uint64_t lineHash = FNV64_OFFSET;
 
-        printf("Internal error: cannot get word %i (indexed) from string with %i words\n", w, countArgs(str));
-        exit(-2);
+            while(c < end && *c != '\n') lineHash = (lineHash ^ (uint8_t) *c++) * FNV64_PRIME;
+            if(c < end) c++;
+
+            blockHash = (blockHash ^ lineHash) * FNV64_PRIME;
+            lines++;
+
+            if(lines >= CACHE_BLOCK_MAX_LINES || (lines >= CACHE_BLOCK_MIN_LINES && !(lineHash >> 40 & CACHE_BLOCK_PATTERN))) break;
+
+        }
+
+        if(*count == capacity) {
+
+            capacity *= 2;
+            chunks = realloc(chunks, capacity * sizeof(Chunk));
+
+        }
+
+        chunks[(*count)++] = (Chunk) { .start = blockStart, .len = c - blockStart, .hash = blockHash };
+        *sourceHash = (*sourceHash ^ blockHash) * FNV64_PRIME;
 
     }
 
-    for(int i = 0; i < w; i++) {
+    return chunks;
+
+}
+
+bool loadCache(char* cachefile, Cache* cache) {
+    // Reads a cache file and indexes its blocks by hash
+    // Returns false if there is no cache file or it was written by another version, in which case everything is assembled
+
+    FILE* cacheFile;
+
+    if(!(cacheFile = fopen(cachefile, "rb"))) return false;
+
+    fseek(cacheFile, 0, SEEK_END);
+    long size = ftell(cacheFile);
+    fseek(cacheFile, 0, SEEK_SET);
+
+    cache->contents = malloc(size + 1);
+    cache->size = size;
 
-        str += strnlen(getFirstWord(str), MAX_STRING_LEN) + 1;
+    bool read = size >= (long) sizeof(CacheHeader) && fread(cache->contents, 1, size, cacheFile) == (size_t) size;
+
+    fclose(cacheFile);
+
+    CacheHeader* header = (CacheHeader*) cache->contents;
+
+    if(!read || memcmp(header->magic, CACHE_MAGIC, 4) || header->version != CACHE_VERSION
+        || header->blockCount > (cache->size - sizeof(CacheHeader)) / sizeof(CacheBlock)) {
+
+        freeCache(cache);
+        return false;
 
     }
+    // Every block takes at least a CacheBlock, so a larger block count can only come from a damaged file
+
+    cache->blocks = malloc(header->blockCount * sizeof(CacheBlock*) + 1);
+    cache->indexSlots = CACHE_INDEX_MIN_SLOTS;
+
+    while(cache->indexSlots < header->blockCount * 2ULL) cache->indexSlots *= 2;
+
+    cache->index = calloc(cache->indexSlots, sizeof(uint32_t));
+
+    size_t offset = sizeof(CacheHeader);
+
+    for(uint32_t i = 0; i < header->blockCount; i++) {
+
+        CacheBlock* block = (CacheBlock*) (cache->contents + offset);
+
+        if(offset + sizeof(CacheBlock) > cache->size || block->len > cache->size
+            || offset + getCacheBlockSize(block) > cache->size) {
+
+            freeCache(cache);
+            return false;
+
+        }
+
+        cache->blocks[i] = block;
+        offset += getCacheBlockSize(block);
+
+        uint32_t slot = block->hash & (cache->indexSlots - 1);
+
+        while(cache->index[slot]) slot = (slot + 1) & (cache->indexSlots - 1);
+
+        cache->index[slot] = i + 1;
+
+    }
+
+    return true;
+
+}
+
+void freeCache(Cache* cache) {
+    // Frees a cache read by loadCache() and leaves it empty, so that no block is taken from it
+
+    free(cache->contents);
+    free(cache->blocks);
+    free(cache->index);
+
+    *cache = (Cache) { 0 };
+
+}
+
+bool isUpToDate(Cache* cache, uint64_t sourceHash, uint32_t options, char* writefile) {
+    // Checks if the last run had the same source and options, and its output file has not changed since
+
+    CacheHeader* header = (CacheHeader*) cache->contents;
+    struct stat info;
+
+    if(header->sourceHash != sourceHash || header->options != options || stat(writefile, &info)) return false;
+
+    return (uint64_t) info.st_size == header->outputSize && info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec == header->outputTime;
+
+}
+
+void reuseBlocks(Chunk* chunks, uint32_t count, Cache* cache) {
+    // Takes the results of every block that is in the cache from the cache, so that only the other blocks are assembled
+    // A block is only taken if its text is the same, so two blocks with the same hash can never be mixed up
+    // Labels and fixups refer to names inside the cache, so the cache has to stay around until the output is written
+
+    if(!cache->index) return;
+
+    for(uint32_t i = 0; i < count; i++) {
+
+        Chunk* c = &chunks[i];
+        uint32_t slot = c->hash & (cache->indexSlots - 1);
+        CacheBlock* block = NULL;
+
+        while(cache->index[slot]) {
+
+            CacheBlock* candidate = cache->blocks[cache->index[slot] - 1];
+
+            if(candidate->hash == c->hash && candidate->len == c->len && !memcmp(getCacheBlockText(candidate), c->text, c->len)) {
+
+                block = candidate;
+                break;
+
+            }
+
+            slot = (slot + 1) & (cache->indexSlots - 1);
+
+        }
+
+        if(!block) continue;
+
+        uint32_t* code = (uint32_t*) (block + 1);
+        CacheName* names = (CacheName*) (code + block->codeCount);
+
+        c->code = malloc(block->codeCount * sizeof(uint32_t) + 1);
+        c->codeCount = block->codeCount;
+        memcpy(c->code, code, block->codeCount * sizeof(uint32_t));
+
+        c->labels = malloc(block->labelCount * sizeof(Label) + 1);
+        c->labelCount = c->labelCapacity = block->labelCount;
+
+        for(uint32_t l = 0; l < block->labelCount; l++) {
+
+            CacheName n = names[l];
+            c->labels[l] = (Label) { .labelName = names[l].name, .PCAddress = n.position, .lineNumber = n.lineNumber };
+
+        }
+
+        names += block->labelCount;
+
+        c->fixups = malloc(block->fixupCount * sizeof(Fixup) + 1);
+        c->fixupCount = block->fixupCount;
+
+        for(uint32_t f = 0; f < block->fixupCount; f++) {
+
+            Token name = { .start = names[f].name, .len = strnlen(names[f].name, MAX_INSTRUCTION_LEN) };
+            c->fixups[f] = (Fixup) { .labelName = name, .instructionIndex = names[f].position, .lineNumber = names[f].lineNumber };
+
+        }
+
+        c->lineCount = block->lineCount;
+        c->done = true;
+
+    }
+
+}
+
+void writeCache(char* cachefile, Chunk* chunks, uint32_t count, uint64_t sourceHash, uint32_t options, char* writefile) {
+    // Writes the results of every block to the cache file, along with what is needed to tell if the output is up to date
+
+    FILE* cacheFile;
+    struct stat info;
+
+    if(!(cacheFile = fopen(cachefile, "wb")) || stat(writefile, &info)) {
+
+        printf("Cannot output to file %s.\n", cachefile);
+        printf(USAGE);
+        exit(-1);
+
+    }
+
+    CacheHeader header = {
+
+        .version = CACHE_VERSION, .sourceHash = sourceHash, .outputSize = info.st_size,
+        .outputTime = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec, .options = options, .blockCount = count
+
+    };
+
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    fwrite(&header, sizeof(header), 1, cacheFile);
+
+    for(uint32_t i = 0; i < count; i++) {
+
+        Chunk* c = &chunks[i];
+
+        CacheBlock block = {
+
+            .hash = c->hash, .len = c->len, .lineCount = c->lineCount,
+            .codeCount = c->codeCount, .labelCount = c->labelCount, .fixupCount = c->fixupCount
+
+        };
+
+        size_t size = getCacheBlockSize(&block);
+        uint8_t* record = calloc(1, size);
+
+        memcpy(record, &block, sizeof(block));
+        memcpy(record + sizeof(block), c->code, c->codeCount * sizeof(uint32_t));
+
+        CacheName* names = (CacheName*) (record + sizeof(block) + c->codeCount * sizeof(uint32_t));
+
+        for(uint32_t l = 0; l < c->labelCount; l++, names++) {
+
+            names->position = c->labels[l].PCAddress;
+            names->lineNumber = c->labels[l].lineNumber;
+            strncpy(names->name, c->labels[l].labelName, MAX_INSTRUCTION_LEN - 1);
+
+        }
+
+        for(uint32_t f = 0; f < c->fixupCount; f++, names++) {
+
+            Token name = c->fixups[f].labelName;
+
+            names->position = c->fixups[f].instructionIndex;
+            names->lineNumber = c->fixups[f].lineNumber;
+            memcpy(names->name, name.start, name.len < MAX_INSTRUCTION_LEN ? name.len : MAX_INSTRUCTION_LEN - 1);
+
+        }
+
+        memcpy(names, c->text, c->len);
+
+        fwrite(record, 1, size, cacheFile);
+        free(record);
+
+    }
+
+    fclose(cacheFile);
+
+}
+
+size_t getCacheBlockSize(CacheBlock* block) {
+    // Gets the size of a block in the cache file, including its instructions, names, text and padding
+
+    size_t size = sizeof(CacheBlock) + block->codeCount * sizeof(uint32_t)
+        + (block->labelCount + (size_t) block->fixupCount) * sizeof(CacheName) + block->len;
+
+    return (size + 7) & ~(size_t) 7;
+
+}
+
+char* getCacheBlockText(CacheBlock* block) {
+    // Gets where the text of a block starts in the cache file, just after its names
+
+    CacheName* names = (CacheName*) ((uint32_t*) (block + 1) + block->codeCount);
+
+    return (char*) (names + block->labelCount + block->fixupCount);
+
+}
+
+void writeBinary(char* writefile, bool echo) {
+    // Writes all assembled instructions to the .bin file in one write, also printing each of them in hex unless quiet
+
+    FILE* binFile;
+
+    if(!(binFile = fopen(writefile, "wb"))) {
+
+        printf("Cannot output to file %s.\n", writefile);
+        printf(USAGE);
+        exit(-1);
+
+    }
+
+    if(echo) printListing();
+
+    for(uint32_t i = 0; i < CODE_COUNT; i++) CODE[i] = htonl(CODE[i]);
+
+    fwrite(CODE, sizeof(uint32_t), CODE_COUNT, binFile);
+
+    fclose(binFile);
+
+}
+
+void writeObject(char* writefile, bool echo) {
+    // Writes all assembled instructions to a relocatable .obj file along with the symbols and relocations
+    // Every jump is still a fixup at this point, so each fixup becomes one relocation
+
+    FILE* objFile;
+
+    if(!(objFile = fopen(writefile, "wb"))) {
+
+        printf("Cannot output to file %s.\n", writefile);
+        printf(USAGE);
+        exit(-1);
+
+    }
+
+    for(uint32_t i = 0; i < FIXUP_COUNT; i++) addImport(FIXUPS[i].labelName);
+
+    if(echo) printListing();
+
+    uint32_t nameBytes = 0;
+
+    for(uint32_t i = 0; i < SYMBOL_COUNT; i++) nameBytes += strlen(SYMBOL_TABLE[i].labelName) + 1;
+
+    uint32_t header[6] = { 0, htonl(OBJECT_VERSION), htonl(CODE_COUNT), htonl(SYMBOL_COUNT), htonl(FIXUP_COUNT), htonl(nameBytes) };
+    memcpy(header, OBJECT_MAGIC, 4);
+
+    uint32_t* symbols = malloc(SYMBOL_COUNT * 2 * sizeof(uint32_t) + 1);
+    uint32_t* relocations = malloc(FIXUP_COUNT * 2 * sizeof(uint32_t) + 1);
+    char* names = malloc(nameBytes + 1);
+    uint32_t nameOffset = 0;
+
+    for(uint32_t i = 0; i < SYMBOL_COUNT; i++) {
+
+        Label l = SYMBOL_TABLE[i];
+        uint32_t len = strlen(l.labelName) + 1;
+
+        symbols[i * 2] = htonl(nameOffset);
+        symbols[i * 2 + 1] = htonl(l.imported ? OBJECT_IMPORT : l.PCAddress);
+
+        memcpy(names + nameOffset, l.labelName, len);
+        nameOffset += len;
+
+    }
+
+    for(uint32_t i = 0; i < FIXUP_COUNT; i++) {
+
+        relocations[i * 2] = htonl(FIXUPS[i].instructionIndex);
+        relocations[i * 2 + 1] = htonl(findLabel(FIXUPS[i].labelName));
+
+    }
+
+    for(uint32_t i = 0; i < CODE_COUNT; i++) CODE[i] = htonl(CODE[i]);
+
+    fwrite(header, sizeof(uint32_t), 6, objFile);
+    fwrite(CODE, sizeof(uint32_t), CODE_COUNT, objFile);
+    fwrite(symbols, sizeof(uint32_t), SYMBOL_COUNT * 2, objFile);
+    fwrite(relocations, sizeof(uint32_t), FIXUP_COUNT * 2, objFile);
+    fwrite(names, 1, nameBytes, objFile);
+
+    fclose(objFile);
+
+    free(symbols);
+    free(relocations);
+    free(names);
+
+}
+
+void printListing() {
+    // Prints every assembled instruction in hex, building the text in memory first so that it is written at once
+    // rather than with a printf per instruction
+
+    char* text = malloc(CODE_COUNT * 9 + 1);
+    char* c = text;
+
+    for(uint32_t i = 0; i < CODE_COUNT; i++) {
+
+        for(int shift = 28; shift >= 0; shift -= 4) *c++ = "0123456789ABCDEF"[(CODE[i] >> shift) & 0xF];
+        *c++ = '\n';
+
+    }
+
+    fflush(stdout);
+    fwrite(text, 1, c - text, stdout);
+
+    free(text);
+
+}
+
+void writeSymbols(char* binfile) {
+    // Writes the symbol table to a .sym file with the same name as the given .bin file
+
+    char symfile[MAX_STRING_LEN];
+    FILE* symFile;
+
+    snprintf(symfile, MAX_STRING_LEN, "%.*s.sym", (int) strnlen(binfile, MAX_STRING_LEN) - 4, binfile);
+
+    if(!(symFile = fopen(symfile, "w"))) {
+
+        printf("Cannot output to file %s.\n", symfile);
+        printf(USAGE);
+        exit(-1);
+
+    }
+
+    for(uint32_t i = 0; i < SYMBOL_COUNT; i++) {
+
+        if(!SYMBOL_TABLE[i].imported) fprintf(symFile, "0x%.4X %s\n", SYMBOL_TABLE[i].PCAddress, SYMBOL_TABLE[i].labelName);
+
+    }
+
+    fclose(symFile);
+
+}
+
+uint32_t assembleInstruction(char* instruction) {
+    // Assembles all instruction types into their respective numeric values
+    // The instruction is split into words once, the mnemonic gives the opcode and format, and the format says how to
+    // encode each operand
+
+    Line line;
+    splitLine(instruction, &line);
+
+    const Mnemonic* mnemonic = findMnemonic(line.words[0]);
+
+    if(!mnemonic) {
+
+        abandonChunk();
+        printf("Invalid instruction at line %i\n", LINE_NUMBER);
+        printf("Instruction: %s\n", instruction);
+
+        exit(-1);
+
+    }
+
+    const InstructionFormat* format = &FORMATS[mnemonic->format];
+    uint32_t instructionNum = mnemonic->opcode << 24;
+
+    if(mnemonic->format == FORMAT_HALT) return instructionNum;
+    // HALT has never looked at anything written after it
+
+    checkArgCount(&line, format->operandCount + 1);
+
+    for(int arg = 1; arg <= format->operandCount; arg++) {
+
+        instructionNum += encodeOperand(&line, arg, format->operands[arg - 1], format->shifts[arg - 1]);
+
+    }
+
+    return instructionNum;
+
+}
+
+void emitInstruction(uint32_t instruction) {
+    // Adds an assembled instruction to the end of the machine code
+
+    if(CODE_COUNT == CODE_CAPACITY) {
+
+        CODE_CAPACITY = CODE_CAPACITY ? CODE_CAPACITY * 2 : 1024;
+        CODE = realloc(CODE, CODE_CAPACITY * sizeof(uint32_t));
+
+    }
+
+    CODE[CODE_COUNT++] = instruction;
+
+}
+
+void addFixup(Token lbl) {
+    // Records that the instruction being assembled jumps to a label that has not been defined yet
+
+    if(FIXUP_COUNT == FIXUP_CAPACITY) {
+
+        FIXUP_CAPACITY = FIXUP_CAPACITY ? FIXUP_CAPACITY * 2 : 256;
+        FIXUPS = realloc(FIXUPS, FIXUP_CAPACITY * sizeof(Fixup));
+
+    }
+
+    FIXUPS[FIXUP_COUNT++] = (Fixup) { .labelName = lbl, .instructionIndex = CODE_COUNT, .lineNumber = LINE_NUMBER };
+
+}
+
+void initMnemonics() {
+    // Places every mnemonic into the mnemonic hash table
+
+    for(uint32_t i = 0; i < sizeof(MNEMONICS) / sizeof(Mnemonic); i++) {
+
+        Token name = { .start = MNEMONICS[i].name, .len = strlen(MNEMONICS[i].name) };
+        uint32_t slot = hashWord(name) & (MNEMONIC_SLOTS - 1);
+
+        while(MNEMONIC_INDEX[slot]) slot = (slot + 1) & (MNEMONIC_SLOTS - 1);
+
+        MNEMONIC_INDEX[slot] = i + 1;
+
+    }
+
+}
+
+const Mnemonic* findMnemonic(Token word) {
+    // Finds the mnemonic matching a given word, or returns NULL if the word is not an instruction name
+
+    uint32_t slot = hashWord(word) & (MNEMONIC_SLOTS - 1);
+
+    while(MNEMONIC_INDEX[slot]) {
+
+        const Mnemonic* mnemonic = &MNEMONICS[MNEMONIC_INDEX[slot] - 1];
+
+        if(wordIs(word, mnemonic->name)) return mnemonic;
+
+        slot = (slot + 1) & (MNEMONIC_SLOTS - 1);
+
+    }
+
+    return NULL;
+
+}
+
+uint32_t encodeOperand(Line* line, int arg, OperandType type, uint8_t shift) {
+    // Checks the syntax of an operand and gets its value shifted into place in the instruction
+
+    Token word = line->words[arg];
+
+    if((type == OPERAND_REGISTER && !fitsRegisterSyntax(word))
+        || (type == OPERAND_IMMEDIATE && !fitsImmediateSyntax(word))) {
+
+        abandonChunk();
+        printf("Wrong format of argument %i at line %i\n", arg, LINE_NUMBER);
+        printf("Instruction: %s\n", line->text);
+        exit(-1);
+
+    }
+
+    if(type == OPERAND_REGISTER) return getRegisterNum(word) << shift;
+    else if(type == OPERAND_IMMEDIATE) return getImmediateVal(word) << shift;
+
+    int32_t label = findLabel(word);
+
+    if(label >= 0 && !OBJECT_OUTPUT) return SYMBOL_TABLE[label].PCAddress << shift;
+
+    addFixup(word);
+    return 0;
+    // Jumps to labels further down are filled in by patchFixups() once the whole source has been read
+    // In an object file every jump needs a relocation, so all of them are kept as fixups
+
+}
+
+void addLabel(char* lbl, uint16_t addr, uint32_t line) {
+    // Adds a label to the symbol table, terminating the program if it is already there
+
+    Token name = { .start = lbl, .len = strnlen(lbl, MAX_INSTRUCTION_LEN) };
+
+    if(findLabel(name) >= 0) {
+
+        printf("Label %s at line %i is already defined\n", lbl, line);
+        exit(-1);
+
+    }
+
+    if(SYMBOL_COUNT == SYMBOL_CAPACITY) {
+
+        SYMBOL_CAPACITY = SYMBOL_CAPACITY ? SYMBOL_CAPACITY * 2 : SYMBOL_INDEX_MIN_SLOTS / 2;
+        SYMBOL_TABLE = realloc(SYMBOL_TABLE, SYMBOL_CAPACITY * sizeof(Label));
+
+    }
+
+    if((SYMBOL_COUNT + 1) * 2 > SYMBOL_INDEX_SLOTS) growSymbolIndex();
+
+    SYMBOL_TABLE[SYMBOL_COUNT] = (Label) { .labelName = copyLabelName(lbl), .PCAddress = addr, .lineNumber = line };
+
+    uint32_t slot = hashWord(name) & (SYMBOL_INDEX_SLOTS - 1);
+
+    while(SYMBOL_INDEX[slot]) slot = (slot + 1) & (SYMBOL_INDEX_SLOTS - 1);
+
+    SYMBOL_INDEX[slot] = ++SYMBOL_COUNT;
+
+}
+
+void addChunkLabel(char* lbl) {
+    // Keeps a label defined in this thread's chunk aside until the chunks are merged
+    // The symbol table stays empty while chunks are assembled, so every jump in a chunk becomes a forward reference
+
+    if(CHUNK->labelCount == CHUNK->labelCapacity) {
+
+        CHUNK->labelCapacity = CHUNK->labelCapacity ? CHUNK->labelCapacity * 2 : 256;
+        CHUNK->labels = realloc(CHUNK->labels, CHUNK->labelCapacity * sizeof(Label));
+
+    }
+
+    CHUNK->labels[CHUNK->labelCount++] = (Label) { .labelName = lbl, .PCAddress = INSTRUCTION_ADDR, .lineNumber = LINE_NUMBER };
+
+}
+
+void addImport(Token lbl) {
+    // Adds a label that the module jumps to but does not define to the end of the symbol table, once
+
+    if(findLabel(lbl) >= 0) return;
+
+    char name[MAX_INSTRUCTION_LEN];
+    snprintf(name, MAX_INSTRUCTION_LEN, "%.*s", lbl.len, lbl.start);
+
+    addLabel(name, 0, LINE_NUMBER);
+    SYMBOL_TABLE[SYMBOL_COUNT - 1].imported = true;
+
+}
+
+int32_t findLabel(Token lbl) {
+    // Finds the position of a label in the symbol table, or returns -1 if it is not there
+
+    if(!SYMBOL_INDEX_SLOTS) return -1;
+
+    uint32_t slot = hashWord(lbl) & (SYMBOL_INDEX_SLOTS - 1);
+
+    while(SYMBOL_INDEX[slot]) {
+
+        char* name = SYMBOL_TABLE[SYMBOL_INDEX[slot] - 1].labelName;
+
+        if(!strncmp(name, lbl.start, lbl.len) && !name[lbl.len]) return SYMBOL_INDEX[slot] - 1;
+
+        slot = (slot + 1) & (SYMBOL_INDEX_SLOTS - 1);
+
+    }
+
+    return -1;
+
+}
+
+void growSymbolIndex() {
+    // Doubles the number of slots in the hash index (or creates it), and puts every label back in
+
+    SYMBOL_INDEX_SLOTS = SYMBOL_INDEX_SLOTS ? SYMBOL_INDEX_SLOTS * 2 : SYMBOL_INDEX_MIN_SLOTS;
+
+    free(SYMBOL_INDEX);
+    SYMBOL_INDEX = calloc(SYMBOL_INDEX_SLOTS, sizeof(uint32_t));
+
+    for(uint32_t i = 0; i < SYMBOL_COUNT; i++) {
+
+        char* name = SYMBOL_TABLE[i].labelName;
+        uint32_t slot = hashWord((Token) { .start = name, .len = strlen(name) }) & (SYMBOL_INDEX_SLOTS - 1);
+
+        while(SYMBOL_INDEX[slot]) slot = (slot + 1) & (SYMBOL_INDEX_SLOTS - 1);
+
+        SYMBOL_INDEX[slot] = i + 1;
+
+    }
+
+}
+
+uint32_t hashWord(Token word) {
+    // Gets the FNV-1a hash of a word, such as a label name or a mnemonic
+
+    uint32_t hash = 0x811C9DC5;
+
+    for(uint32_t i = 0; i < word.len; i++) hash = (hash ^ (uint8_t) word.start[i]) * 0x01000193;
+
+    return hash;
+
+}
+
+char* copyLabelName(char* lbl) {
+    // Copies a label name into the label arena, starting a new block of the arena when the current one is full
+
+    size_t len = strnlen(lbl, MAX_INSTRUCTION_LEN) + 1;
+
+    if(len > LABEL_ARENA_LEFT) {
+
+        char* block = malloc(LABEL_ARENA_BLOCK);
+
+        *(char**) block = LABEL_BLOCKS;
+        LABEL_BLOCKS = block;
+
+        LABEL_ARENA = block + sizeof(char*);
+        LABEL_ARENA_LEFT = LABEL_ARENA_BLOCK - sizeof(char*);
+
+    }
+
+    char* name = LABEL_ARENA;
+
+    memcpy(name, lbl, len - 1);
+    name[len - 1] = '\0';
+
+    LABEL_ARENA += len;
+    LABEL_ARENA_LEFT -= len;
+
+    return name;
+
+}
+
+void freeLabelNames() {
+    // Frees every block of label names at once
+
+    while(LABEL_BLOCKS) {
+
+        char* previous = *(char**) LABEL_BLOCKS;
+
+        free(LABEL_BLOCKS);
+        LABEL_BLOCKS = previous;
+
+    }
+
+    LABEL_ARENA = NULL;
+    LABEL_ARENA_LEFT = 0;
+
+}
+
+uint16_t getLabelAddr(Token lbl) {
+    // Reads the symbol table and finds a corresponding label address, terminating the program if none is found
+
+    int32_t label = findLabel(lbl);
+
+    if(label >= 0) return SYMBOL_TABLE[label].PCAddress;
+
+    printf("Cannot use label %.*s at line %i because it does not exist in the symbol table\n", lbl.len, lbl.start, LINE_NUMBER);
+    exit(-1);
+
+}
+
+uint8_t getRegisterNum(Token word) {
+    // Gets the register address from a given word
+    // Assumes that word has already been validated as a proper register address argument
+
+    if(wordIs(word, "RZR")) return 0;
+    else if(wordIs(word, "RSP")) return 15;
+    else if(wordIs(word, "RBP")) return 14;
+    else if(wordIs(word, "RLR")) return 13;
+
+    return getWordNum(word);
+
+}
+
+uint16_t getImmediateVal(Token word) {
+    // Gets the immediate value from a given word
+    // Assumes that word has already been validated as a proper immediate argument
+
+    return getWordNum(word);
+
+}
+
+uint32_t getWordNum(Token word) {
+    // Gets the number written after the first character of a word, such as the 12 in "R12" or "#12"
+    // Stops counting once the number is over INT_LIMIT, so that very long numbers cannot overflow
+
+    uint32_t num = 0;
+
+    for(uint32_t i = 1; i < word.len && num <= INT_LIMIT; i++) num = num * 10 + (word.start[i] - '0');
+
+    return num;
+
+}
+
+bool fitsRegisterSyntax(Token word) {
+    // Checks if a given word fits the SMIS register standard syntax "R<4-bit unsigned register address>"
+
+    if(!word.len || *word.start != 'R') return false;
+
+    if(wordIs(word, "RZR")) return true;
+    else if(wordIs(word, "RSP")) return true;
+    else if(wordIs(word, "RBP")) return true;
+    else if(wordIs(word, "RLR")) return true;
+
+    if(!containsOnlyNums(word.start + 1, word.len - 1)) return false;
+
+    if(getWordNum(word) > 15) return false;
+
+    return true;
+
+}
+
+bool fitsImmediateSyntax(Token word) {
+    // Checks if a given word fits the SMIS immediate standard syntax "#<16-bit unsigned int>"
+
+    if(!word.len || *word.start != '#') return false;
+
+    if(!containsOnlyNums(word.start + 1, word.len - 1)) return false;
+
+    if(getWordNum(word) > INT_LIMIT) return false;
+
+    return true;
+
+}
+
+void splitLine(char* instruction, Line* line) {
+    // Splits an instruction into its space-separated words, which point into the instruction rather than being copied
+
+    line->text = instruction;
+    line->wordCount = 0;
+
+    char* word = instruction;
+
+    for(char* c = instruction; ; c++) {
+
+        if(*c && *c != ' ') continue;
+
+        if(*c == ' ' && c[1] == ' ') {
+
+            abandonChunk();
+            printf("Incorrect spacing at line %i\n", LINE_NUMBER);
+            printf("Instruction: %s\n", instruction);
+            exit(-1);
+
+        }
+
+        line->words[line->wordCount++] = (Token) { .start = word, .len = c - word };
+
+        if(!*c) break;
+
+        word = c + 1;
+
+    }
+
+}
+
+void checkArgCount(Line* line, int count) {
+    // Terminates the program if a line does not have the given number of words
+
+    if(line->wordCount != count) {
+
+        abandonChunk();
+        printf("Incorrect number of arguments at line %i\n", LINE_NUMBER);
+        printf("Instruction: %s\n", line->text);
+        exit(-1);
+
+    }
+
+}
+
+bool isBlankLineOrComment(char* str) {
+    // Checks a line of the ASM file to see if it should be skipped
+
+    if(!*str || !strncmp(str, "\n", 2) || !strncmp(str, "//", 2)) return true;
+
+    return false;
+
+}
+
+bool isLabel(char* str) {
+    // Checks if a given line ends with a ':', denoting that it is a jump label
+
+    trimLineBreak(str);
+    int len = strnlen(str, MAX_STRING_LEN) - 1;
+
+    return str[len] == ':';
+
+}
+
+void trimLineBreak(char* str) {
+    // Trims a trailing line break from a given string
+
+    trimChar(str, '\n');
+
+}
+
+void trimLabelColon(char* str) {
+    // Trims a trailing colon from a given string
+
+    trimChar(str, ':');
+
+}
+
+void trimChar(char* str, char c) {
+    // Trims the first instance of a given character from the end of a given string
+    // If the string does not contain the character, it remains unchanged
+
+    int len = strnlen(str, MAX_STRING_LEN);
+
+    for(int i = len; i >= 0; i--) {
+        
+        if(str[i] == c) {
+            
+            str[i] = '\0';
+            return;
+
+        }
+
+    }
+
+}
+
+bool containsOnlyNums(char* str, uint32_t len) {
+    // Checks if the first len characters of a given string are all numerical digit characters
+
+    for(uint32_t i = 0; i < len; i++) if(str[i] < '0' || str[i] > '9') return false;
+
+    return true;
+
+}
+
+bool wordIs(Token word, char* str) {
+    // Checks if a given word is exactly the same as a given string
 
-    return getFirstWord(str);
+    return !strncmp(word.start, str, word.len) && !str[word.len];
 
 }
 
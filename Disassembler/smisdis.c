@@ -8,7 +8,7 @@ Program overview:
 
     The disassembly work is done in two passes.
 
-    (Setup) The input .bin machine code file and the output .txt ASM file are opened.
+    (Setup) The whole input .bin machine code file is read into memory at once.
 
     (Pass 1)
         The machine code file is scanned for jump labels by reading J-Type instruction
@@ -21,6 +21,8 @@ Program overview:
         including their operands, into the ASM file. Jump instruction addresses are checked
         against the symbol table, and if the label is found, they are disassembled into their
         corresponding label name. If a label does not exist, the file cannot be disassembled.
+        The ASM is built up in memory and written to the .txt file in one go, and the same text is
+        printed unless --quiet is given.
 
 */
 
@@ -33,7 +35,7 @@ Program overview:
 #include <arpa/inet.h>
 
 
-#define USAGE "Usage: ./smisdis <input .bin machine code file> <output .txt ASM file>\n"
+#define USAGE "Usage: ./smisdis [--quiet] <input .bin machine code file> <output .txt ASM file>\n"
 #define MAX_INSTRUCTION_LEN 50
 #define MAX_STRING_LEN 500
 #define INT_LIMIT 65535
@@ -98,13 +100,22 @@ Label* SYMBOL_TABLE;
 // Stores all labels in the assembled file
 uint32_t SYMBOL_COUNT = 0;
 // Stores the amount of symbols to avoid iterating over unallocated pointers
+uint32_t LABEL_AT[INT_LIMIT + 1];
+// Stores the position in SYMBOL_TABLE plus 1 of the label at each address, with 0 meaning there is no label there
 
 uint16_t INSTRUCTION_ADDR = 0;
 // Instruction address is stored for symbol table usage
 
+char* OUTPUT = NULL;
+size_t OUTPUT_LEN = 0;
+size_t OUTPUT_CAPACITY = 0;
+// Stores the disassembled ASM until all instructions have been disassembled
 
-void createLabels(char* readfile);
-void readInstructions(char* readfile, char* writefile);
+
+uint32_t* readProgram(char* readfile, uint32_t* count);
+void createLabels(uint32_t* program, uint32_t count);
+void readInstructions(uint32_t* program, uint32_t count, char* writefile, bool echo);
+void appendLine(char* str);
 // Program control functions
 
 char* disassembleInstruction(uint32_t instruction);
@@ -134,7 +145,9 @@ void trimChar(char* str, char c);
 
 int main(int argc, char** argv) {
 
-    if(argc != 3) {
+    bool quiet = argc == 4 && !strncmp(argv[1], "--quiet", MAX_STRING_LEN);
+
+    if(argc != 3 && !quiet) {
 
         printf("Incorrect number of arguments supplied.\n");
         printf(USAGE);
@@ -142,7 +155,10 @@ int main(int argc, char** argv) {
 
     }
 
-    if(!endsWith(argv[1], ".bin") || !endsWith(argv[2], ".txt")) {
+    char* readfile = argv[argc - 2];
+    char* writefile = argv[argc - 1];
+
+    if(!endsWith(readfile, ".bin") || !endsWith(writefile, ".txt")) {
 
         printf("One or both of the supplied files have incorrect extensions.\n");
         printf(USAGE);
@@ -152,14 +168,21 @@ int main(int argc, char** argv) {
 
     SYMBOL_TABLE = NULL;
 
-    createLabels(argv[1]);
-    readInstructions(argv[1], argv[2]);
+    uint32_t count;
+    uint32_t* program = readProgram(readfile, &count);
+
+    createLabels(program, count);
+    readInstructions(program, count, writefile, !quiet);
 
     free(SYMBOL_TABLE);
+    free(program);
+    free(OUTPUT);
     
 }
 
-void createLabels(char* readfile) {
+uint32_t* readProgram(char* readfile, uint32_t* count) {
+    // Reads all whole instructions of the machine code file into memory, so that both passes can go over it without
+    // reading the file again
 
     FILE* binFile;
 
@@ -171,11 +194,33 @@ void createLabels(char* readfile) {
 
     }
 
-    uint32_t instruction;
-    
-    while(fread(&instruction, 4, 1, binFile)) {
+    fseek(binFile, 0, SEEK_END);
+    long size = ftell(binFile);
+    fseek(binFile, 0, SEEK_SET);
+
+    *count = size > 0 ? size / 4 : 0;
+    uint32_t* program = malloc(*count * sizeof(uint32_t) + 1);
+
+    if(fread(program, sizeof(uint32_t), *count, binFile) != *count) {
+
+        printf("Cannot read file %s.\n", readfile);
+        exit(-1);
+
+    }
+
+    for(uint32_t i = 0; i < *count; i++) program[i] = ntohl(program[i]);
+
+    fclose(binFile);
 
-        instruction = ntohl(instruction);
+    return program;
+
+}
+
+void createLabels(uint32_t* program, uint32_t count) {
+
+    for(uint32_t i = 0; i < count; i++) {
+
+        uint32_t instruction = program[i];
         
         uint16_t addr = getDestOrImmVal(instruction);
 
@@ -193,6 +238,7 @@ void createLabels(char* readfile) {
                 SYMBOL_TABLE[SYMBOL_COUNT] = l;
                 
                 SYMBOL_COUNT++;
+                LABEL_AT[addr] = SYMBOL_COUNT;
 
             }
 
@@ -200,23 +246,12 @@ void createLabels(char* readfile) {
 
     }
 
-    fclose(binFile);
-
 }
 
-void readInstructions(char* readfile, char* writefile) {
+void readInstructions(uint32_t* program, uint32_t count, char* writefile, bool echo) {
 
-    FILE* binFile;
     FILE* txtFile;
 
-    if(!(binFile = fopen(readfile, "rb"))) {
-
-        printf("File %s does not exist.\n", readfile);
-        printf(USAGE);
-        exit(-1);
-
-    }
-
     if(!(txtFile = fopen(writefile, "w"))) {
 
         printf("File %s does not exist.\n", writefile);
@@ -225,37 +260,51 @@ void readInstructions(char* readfile, char* writefile) {
 
     }
 
-    uint32_t instruction;
-    
-    while(fread(&instruction, 4, 1, binFile)) {
+    for(uint32_t i = 0; i < count; i++) {
 
-        instruction = ntohl(instruction);
+        uint32_t instruction = program[i];
 
         if(labelExists(INSTRUCTION_ADDR)) {
 
-            if(INSTRUCTION_ADDR != 0) fputc('\n', txtFile);
-            fprintf(txtFile, "%s\n", getLabelName(INSTRUCTION_ADDR));
+            if(INSTRUCTION_ADDR != 0) appendLine("");
+            appendLine(getLabelName(INSTRUCTION_ADDR));
 
         }
 
-        fprintf(txtFile, "%s\n", disassembleInstruction(instruction));
+        appendLine(disassembleInstruction(instruction));
 
         INSTRUCTION_ADDR += 2;
 
     }
 
-    freopen(writefile, "r", txtFile);
+    fwrite(OUTPUT, 1, OUTPUT_LEN, txtFile);
 
-    char* instructionStr = malloc(MAX_INSTRUCTION_LEN * sizeof(char));
-    while(fgets(instructionStr, MAX_INSTRUCTION_LEN, txtFile)) printf("%s", instructionStr);
-    free(instructionStr);
-    // TODO: Possible refactor into separate function
+    if(echo) fwrite(OUTPUT, 1, OUTPUT_LEN, stdout);
+    // The output is printed from memory instead of reading the file back
 
-    fclose(binFile);
     fclose(txtFile);
 
 }
 
+void appendLine(char* str) {
+    // Adds a line to the end of the disassembled ASM, growing the buffer when it is full
+
+    size_t len = strnlen(str, MAX_STRING_LEN);
+
+    if(OUTPUT_LEN + len + 1 > OUTPUT_CAPACITY) {
+
+        OUTPUT_CAPACITY = OUTPUT_CAPACITY ? OUTPUT_CAPACITY * 2 : 0x10000;
+        OUTPUT = realloc(OUTPUT, OUTPUT_CAPACITY);
+
+    }
+
+    memcpy(OUTPUT + OUTPUT_LEN, str, len);
+    OUTPUT[OUTPUT_LEN + len] = '\n';
+
+    OUTPUT_LEN += len + 1;
+
+}
+
 char* disassembleInstruction(uint32_t instruction) {
     // Gets the corresponding line of code for a given instruction
 
@@ -511,19 +560,9 @@ char* formatImmediateVal(uint16_t immVal) {
 }
 
 bool labelExists(uint16_t addr) {
-    // Returns true if a label already exists in the symbol table
-
-    for(int i = 0; i < SYMBOL_COUNT; i++) {
-
-        Label l = SYMBOL_TABLE[i];
+    // Returns true if a label already exists in the symbol table for a given address
 
-        // printf("Requested address: %.4X\nLabel name: %s\nLabel address: %.4X\n", addr, l.labelName, l.PCAddress);
-
-        if(addr == l.PCAddress) return true;
-
-    }
-
-    return false;
+    return LABEL_AT[addr];
 
 }
 
@@ -561,18 +600,14 @@ uint16_t getDestOrImmVal(uint32_t instruction) {
 char* getLabelName(uint16_t addr) {
     // Gets the label name associated with a given address
 
-    for(int i = 0; i < SYMBOL_COUNT; i++) {
+    if(LABEL_AT[addr]) {
 
-        Label l = SYMBOL_TABLE[i];
+        Label l = SYMBOL_TABLE[LABEL_AT[addr] - 1];
 
-        if(addr == l.PCAddress) {
-            
-            char* lblName = malloc(MAX_INSTRUCTION_LEN * sizeof(char));
-            strncpy(lblName, l.labelName, MAX_INSTRUCTION_LEN);
-            
-            return lblName;
-        
-        }
+        char* lblName = malloc(MAX_INSTRUCTION_LEN * sizeof(char));
+        strncpy(lblName, l.labelName, MAX_INSTRUCTION_LEN);
+
+        return lblName;
 
     }
 
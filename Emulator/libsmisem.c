@@ -0,0 +1,2681 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(SMISEM_NO_JIT)
+#define SMISEM_JIT
+#endif
+// The JIT emits x86-64 machine code directly, build with -DSMISEM_NO_JIT to leave it out
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(SMISEM_NO_SIMD)
+#define SMISEM_SIMD
+#include <immintrin.h>
+#endif
+// Program images are byte-swapped 16 bytes at a time with SSSE3 when the CPU has it, build with -DSMISEM_NO_SIMD to leave it out
+
+#include "libsmisem.h"
+
+
+#if defined(__GNUC__) && !defined(SMISEM_NO_THREADED)
+#define SMISEM_THREADED
+#endif
+// The threaded engine needs GCC/Clang labels-as-values, build with -DSMISEM_NO_THREADED to leave it out
+
+#define BLOCK_MAX_LEN       128
+#define BLOCK_ARENA_SIZE    0x400000
+#define BLOCK_SIZE(length) ((sizeof(Block) + (length) * sizeof(DecodedInstruction) + 7) & ~7)
+// Cached blocks are bump-allocated, and the whole cache is flushed once the arena is full
+
+#define PAGE_SHIFT          8
+#define PAGE_WORDS          (1 << PAGE_SHIFT)
+#define PAGE_COUNT          (0x10000 >> PAGE_SHIFT)
+// Memory is split into pages for watching writes to cached code and for tracking what a reset has to clear
+
+#define CODE_PAGE_NONE      0
+#define CODE_PAGE_CACHED    1
+#define CODE_PAGE_UNCACHED  2
+// Memory pages holding cached blocks are watched for writes, and a page that is written to is left to the interpreter
+
+#define TRACE_RECORD_MAX    14
+#define TRACE_CHUNK_HEADER  16
+// The longest binary trace record (every optional field present), and the size of a chunk header
+
+#define BUDGET_CLOCK_INTERVAL 0x100000
+// With a time budget, the clock is read once every this many instructions
+
+#define SEEK_STEP_MARGIN    0x8000
+// A step budget can overshoot by at most one straight line of code, which is never longer than this, so seeking runs
+// at full speed until this far before the target and interprets the rest one instruction at a time
+
+#define LOAD_READ_MAX       0x4000
+// Program images up to this size are read with a single read(), larger ones are memory-mapped
+
+#define SNAPSHOT_MAGIC      "SMSN"
+
+
+static atomic_uint_least64_t MEMORY_VERSIONS = 0;
+// Source of memoryVersion values, shared by every machine so that a version is never reused
+
+#define JIT_CODE_SIZE       0x1000000
+#define JIT_BLOCK_SIZE      0x4000
+#define JIT_EXIT_LEN        32
+#define JIT_STOP_LEN        35
+#define JIT_JUMP_EXIT_LEN   (19 + JIT_STOP_LEN + JIT_EXIT_LEN)
+#define JIT_PROFILE_TAKEN_LEN 13
+// The code buffer is flushed when less than one maximum-size block of space remains
+
+#define EMIT(...) jitEmitBytes(m, (uint8_t[]) { __VA_ARGS__ }, sizeof((uint8_t[]) { __VA_ARGS__ }))
+
+#define MEM (m->memory)
+#define REG (m->registers)
+#define RZR REG[0x0]
+#define RSP REG[0xF]
+#define RBP REG[0xE]
+#define RLR REG[0xD]
+
+#define PC (m->programCounter)
+#define IR (m->instructionRegister)
+#define FLAG_RESULT (m->flagResult)
+#define HALTED (m->status != SMIS_STATUS_RUNNING)
+
+#define DECODE_CACHE (m->decodeCache)
+#define BLOCK_MAP (m->blockMap)
+#define BLOCK_ARENA (m->blockArena)
+#define BLOCK_ARENA_USED (m->blockArenaUsed)
+#define CODE_PAGE_STATE (m->codePageState)
+#define CODE_FLUSH_PENDING (m->codeFlushPending)
+
+#define JIT_CODE (m->jitCode)
+#define JIT_EMIT (m->jitEmit)
+#define JIT_BLOCKS_START (m->jitBlocksStart)
+#define JIT_EPILOGUE (m->jitEpilogue)
+#define JIT_ENTER (m->jitEnter)
+#define JIT_BLOCKS (m->jitBlocks)
+// All machine state lives in a Machine, and is reached through the m that every emulator function is handed
+
+#define ZF (FLAG_RESULT == 0x0000)
+#define SF (FLAG_RESULT >> 15)
+// Flags are evaluated lazily from the last flag-setting result, only when something reads them
+
+#define OP_SET              1
+#define OP_COPY             2
+
+#define OP_ADD              3
+#define OP_SUBTRACT         4
+#define OP_MULTIPLY         5
+#define OP_DIVIDE           6
+#define OP_MODULO           7
+
+#define OP_COMPARE          8
+
+#define OP_SHIFT_LEFT       9
+#define OP_SHIFT_RIGHT      10
+
+#define OP_AND              11
+#define OP_OR               12
+#define OP_XOR              13
+#define OP_NAND             14
+#define OP_NOR              15
+#define OP_NOT              16
+
+#define OP_ADD_IMM          17
+#define OP_SUBTRACT_IMM     18
+#define OP_MULTIPLY_IMM     19
+#define OP_DIVIDE_IMM       20
+#define OP_MODULO_IMM       21
+
+#define OP_COMPARE_IMM      22
+#define OP_SHIFT_LEFT_IMM   23
+#define OP_SHIFT_RIGHT_IMM  24
+#define OP_AND_IMM          25
+#define OP_OR_IMM           26
+#define OP_XOR_IMM          27
+#define OP_NAND_IMM         28
+#define OP_NOR_IMM          29
+
+#define OP_LOAD             30
+#define OP_STORE            31
+
+#define OP_JUMP             32
+#define OP_JUMP_IF_ZERO     33
+#define OP_JUMP_IF_NOTZERO  34
+#define OP_JUMP_LINK        35
+
+#define OP_HALT             36
+
+#define OP_UNDECODED        0
+#define OP_INVALID          0xFF
+// Pseudo-opcodes used only by the decode cache
+
+
+typedef struct DecodedInstruction {
+
+    uint8_t opcode;
+    uint8_t rDest;
+    uint8_t rOp1;
+    uint8_t rOp2;
+    uint16_t iVal;
+
+} DecodedInstruction;
+// An instruction with all of its fields already extracted, so it only has to be decoded once
+
+typedef struct Block {
+
+    uint16_t startAddr;
+    uint16_t length;
+    struct Block* next[2];
+    // Chained successors, [0] for the jump target and [1] for the fall-through address
+    DecodedInstruction ops[];
+
+} Block;
+// A straight-line run of instructions ending at a jump or HALT (or cut short by the length limit or an uncached page)
+
+typedef struct Profile {
+
+    int64_t segments[0x10002];
+    // Every straight line of code run from a to b adds 1 at a and subtracts 1 at b, so the running sum over every
+    // other address gives how often each instruction ran, the last two entries count lines that wrapped past 0xFFFF
+    // (for even and odd addresses) and so cover every address of their parity
+    uint64_t taken[0x10000];
+
+} Profile;
+// Profiling counters, which are only touched by jumps so that profiling can stay on without slowing programs down
+
+typedef struct SnapshotHeader {
+
+    char magic[4];
+    uint16_t version;
+    uint16_t pageCount;
+    uint16_t registers[0x10];
+    uint16_t programCounter;
+    uint16_t flagResult;
+    uint8_t status;
+    uint8_t pages[PAGE_COUNT];
+    uint64_t steps;
+
+} SnapshotHeader;
+// The start of a snapshot file, followed by the contents of the pages listed in pages[0] to pages[pageCount - 1]
+
+
+struct SmisMachine {
+
+    uint16_t memory[0x10000];
+    uint16_t registers[0x10];
+
+    uint16_t programCounter;
+    uint32_t instructionRegister;
+
+    uint16_t flagResult;
+    // Every flag-setting instruction derives ZF and SF from its 16-bit result alone, so the result is all that needs
+    // to be kept, the reset value of 0x0001 gives ZF = 0 and SF = 0
+
+    uint8_t status;
+    // Set by HALT, an unknown instruction, a divide by zero or a used-up budget so the execution loop can stop without
+    // exiting from inside a handler
+
+    uint64_t steps;
+    uint16_t segmentStart;
+    // Instructions executed since the program was loaded, only brought up to date by jumps and at the end of a run
+    // Everything between the last jump destination and PC is a straight line, so counting it needs no per-instruction work
+
+    uint64_t budgetSteps;
+    uint64_t budgetTime;
+    uint64_t stepLimit;
+    uint64_t deadline;
+    uint64_t nextBudgetCheck;
+    // The per-run budgets set by smisSetBudget(), and the step count and monotonic clock time at which the current
+    // run stops, budgets are only looked at by jumps once the step count reaches nextBudgetCheck
+
+    bool breakpointSet;
+    uint16_t breakpoint;
+    // Set by smisSetBreakpoint(), every jump is checked against it by keeping nextBudgetCheck at 0
+
+    Profile* profile;
+    // NULL unless profiling is on
+
+    uint8_t engine;
+    uint8_t traceLevel;
+    FILE* traceStream;
+
+    SmisTraceSink traceSink;
+    void* traceContext;
+    uint8_t traceChunk[SMIS_TRACE_CHUNK_SIZE];
+    uint32_t traceChunkUsed;
+    uint16_t traceNextPC;
+    // Binary trace records are collected here and handed to the sink (or written to the trace stream) a chunk at a time
+
+    bool touchedPages[PAGE_COUNT];
+    uint8_t touchedPageList[PAGE_COUNT];
+    uint16_t touchedPageCount;
+    // Pages that have been written to or decoded since the last reset, and are all that a reset has to clear
+
+    bool dirtyPages[PAGE_COUNT];
+    uint8_t dirtyPageList[PAGE_COUNT];
+    uint16_t dirtyPageCount;
+    // Pages that have been written to since the last reset or fork, and are all that forking again has to copy back
+
+    SmisMachine* forkParent;
+    uint64_t forkVersion;
+    uint64_t memoryVersion;
+    // The machine this one was last forked from and its memoryVersion at the time, memoryVersion is given a new
+    // value whenever memory may change other than by this machine's own STOREs between forks
+
+    DecodedInstruction decodeCache[0x10000];
+    // Parallel to memory and indexed by PC, entries are decoded on first use and invalidated by STORE
+
+    Block* blockMap[0x10000];
+    // Cached blocks indexed by their entry address
+    uint64_t blockArena[BLOCK_ARENA_SIZE / sizeof(uint64_t)];
+    uint32_t blockArenaUsed;
+
+    uint8_t codePageState[PAGE_COUNT];
+    bool codeFlushPending;
+    // Set by a write into a cached page, the block and JIT caches are flushed before the next block starts
+
+    #ifdef SMISEM_JIT
+    uint8_t* jitCode;
+    // Executable buffer holding the entry/exit trampolines followed by all translated blocks
+    uint8_t* jitEmit;
+    // Next free byte of the code buffer
+    uint8_t* jitBlocksStart;
+    uint8_t* jitEpilogue;
+    uint8_t* (*jitEnter)(uint8_t* block);
+    // Saves host registers, points them at this machine's state and jumps into a block
+    // Returns the exit stub the block left through, or NULL if that exit cannot be chained
+
+    uint8_t* jitBlocks[0x10000];
+    // Translated block entry points indexed by SMIS address
+    #endif
+
+};
+// The complete state of one emulated SMIS machine, so that any number of them can run side by side
+
+static const char* MNEMONICS[] = {
+
+    [OP_SET] = "SET", [OP_COPY] = "COPY",
+    [OP_ADD] = "ADD", [OP_SUBTRACT] = "SUBTRACT", [OP_MULTIPLY] = "MULTIPLY",
+    [OP_DIVIDE] = "DIVIDE", [OP_MODULO] = "MODULO",
+    [OP_COMPARE] = "COMPARE",
+    [OP_SHIFT_LEFT] = "SHIFT-LEFT", [OP_SHIFT_RIGHT] = "SHIFT-RIGHT",
+    [OP_AND] = "AND", [OP_OR] = "OR", [OP_XOR] = "XOR",
+    [OP_NAND] = "NAND", [OP_NOR] = "NOR", [OP_NOT] = "NOT",
+    [OP_ADD_IMM] = "ADD-IMM", [OP_SUBTRACT_IMM] = "SUBTRACT-IMM", [OP_MULTIPLY_IMM] = "MULTIPLY-IMM",
+    [OP_DIVIDE_IMM] = "DIVIDE-IMM", [OP_MODULO_IMM] = "MODULO-IMM",
+    [OP_COMPARE_IMM] = "COMPARE-IMM",
+    [OP_SHIFT_LEFT_IMM] = "SHIFT-LEFT-IMM", [OP_SHIFT_RIGHT_IMM] = "SHIFT-RIGHT-IMM",
+    [OP_AND_IMM] = "AND-IMM", [OP_OR_IMM] = "OR-IMM", [OP_XOR_IMM] = "XOR-IMM",
+    [OP_NAND_IMM] = "NAND-IMM", [OP_NOR_IMM] = "NOR-IMM",
+    [OP_LOAD] = "LOAD", [OP_STORE] = "STORE",
+    [OP_JUMP] = "JUMP", [OP_JUMP_IF_ZERO] = "JUMP-IF-ZERO",
+    [OP_JUMP_IF_NOTZERO] = "JUMP-IF-NOTZERO", [OP_JUMP_LINK] = "JUMP-LINK",
+    [OP_HALT] = "HALT"
+
+};
+// Mnemonic names indexed by opcode, only used for tracing
+
+
+static void copyImage(uint16_t* words, const uint8_t* image, uint32_t count);
+#ifdef SMISEM_SIMD
+static void copyImageSsse3(uint16_t* words, const uint8_t* image, uint32_t count);
+#endif
+static void predecodeProgram(SmisMachine* m, uint16_t endAddr);
+static void executeProgram(SmisMachine* m);
+#ifdef SMISEM_THREADED
+static void executeThreaded(SmisMachine* m);
+#endif
+#ifdef SMISEM_JIT
+static void executeJit(SmisMachine* m);
+#endif
+static void executeBlocks(SmisMachine* m);
+static void executeBlock(SmisMachine* m, Block* block);
+static void executeDecoded(SmisMachine* m, DecodedInstruction* d);
+static void unknownInstruction(SmisMachine* m);
+static void divideByZero(SmisMachine* m);
+static void decodeInstruction(SmisMachine* m, uint16_t addr);
+static void grabNextInstruction(SmisMachine* m);
+static void traceInstruction(SmisMachine* m, uint16_t instructionAddr);
+static void traceBinary(SmisMachine* m, uint16_t instructionAddr);
+static void startTraceChunk(SmisMachine* m);
+static void flushTrace(SmisMachine* m);
+static int putTraceBytes(uint8_t* dest, uint32_t value, int count);
+static void touchPage(SmisMachine* m, uint16_t addr);
+static void copyPage(SmisMachine* m, SmisMachine* source, uint8_t page);
+static void clearDirtyPages(SmisMachine* m);
+static void takeJump(SmisMachine* m, uint16_t destAddr);
+static void checkBudget(SmisMachine* m);
+static void setNextBudgetCheck(SmisMachine* m);
+static void profileSegment(SmisMachine* m, uint16_t endAddr);
+static void profileJump(SmisMachine* m, uint16_t destAddr);
+static uint64_t getTimeNs();
+// Program control functions
+
+static Block* getBlock(SmisMachine* m, uint16_t startAddr);
+static void interpretInstruction(SmisMachine* m);
+static void noteCodeWrite(SmisMachine* m, uint16_t addr);
+static void flushCodeCaches(SmisMachine* m);
+// Block cache functions
+
+#ifdef SMISEM_JIT
+static bool jitInit(SmisMachine* m);
+static uint8_t* jitTranslateBlock(SmisMachine* m, Block* block);
+static bool jitTranslateInstruction(SmisMachine* m, DecodedInstruction* d, uint16_t nextAddr);
+static void jitEmitExit(SmisMachine* m, uint16_t targetAddr);
+static void jitEmitStop(SmisMachine* m, uint8_t status, uint16_t addr);
+static void jitEmitCountSegment(SmisMachine* m, uint16_t nextAddr);
+static void jitEmitJumpExit(SmisMachine* m, uint16_t targetAddr);
+static void jitEmitLoadReg(SmisMachine* m, uint8_t hostReg, uint8_t reg);
+static void jitEmitStoreResult(SmisMachine* m, uint8_t rDest, bool setsFlags);
+static void jitEmitBytes(SmisMachine* m, uint8_t* bytes, int count);
+static void jitEmit16(SmisMachine* m, uint16_t n);
+static void jitEmit32(SmisMachine* m, uint32_t n);
+static void jitEmit64(SmisMachine* m, uint64_t n);
+static void jitChain(uint8_t* exitStub, uint8_t* block);
+static int jitStore(SmisMachine* m, uint16_t value, uint16_t addr);
+#endif
+// JIT compiler functions
+
+static void setFlags(SmisMachine* m, uint16_t result);
+
+static void SET(SmisMachine* m, uint8_t rDest, uint16_t iVal);
+static void COPY(SmisMachine* m, uint8_t rDest, uint8_t rSrc);
+
+static void ADD(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
+static void SUBTRACT(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
+static void MULTIPLY(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
+static void DIVIDE(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
+static void MODULO(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
+
+static void COMPARE(SmisMachine* m, uint8_t rOp1, uint8_t rOp2);
+
+static void SHIFT_LEFT(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
+static void SHIFT_RIGHT(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
+
+static void AND(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
+static void OR(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
+static void XOR(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
+static void NAND(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
+static void NOR(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
+static void NOT(SmisMachine* m, uint8_t rDest, uint8_t rOp);
+
+static void ADD_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
+static void SUBTRACT_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
+static void MULTIPLY_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
+static void DIVIDE_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
+static void MODULO_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
+
+static void COMPARE_IMM(SmisMachine* m, uint8_t rOp1, uint16_t iOp2);
+
+static void SHIFT_LEFT_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
+static void SHIFT_RIGHT_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
+
+static void AND_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
+static void OR_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
+static void XOR_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
+static void NAND_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
+static void NOR_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
+
+static void LOAD(SmisMachine* m, uint8_t rDest, uint8_t rBase, uint16_t iOffset);
+static void STORE(SmisMachine* m, uint8_t rSrc, uint8_t rBase, uint16_t iOffset);
+
+static void JUMP(SmisMachine* m, uint16_t destAddr);
+static void JUMP_IF_ZERO(SmisMachine* m, uint16_t destAddr);
+static void JUMP_IF_NOTZERO(SmisMachine* m, uint16_t destAddr);
+static void JUMP_LINK(SmisMachine* m, uint16_t destAddr);
+
+static void HALT(SmisMachine* m);
+// Instruction execution functions
+
+static void writeMemory(SmisMachine* m, uint16_t addr, uint16_t value);
+
+static uint8_t getOpcode(uint32_t instruction);
+static uint8_t getRegOperand(uint32_t instruction, uint8_t opNum);
+static uint16_t getDestOrImmVal(uint32_t instruction);
+static bool writesRegDest(uint8_t opcode);
+// Emulator utility functions
+
+
+SmisMachine* smisCreate() {
+    // Allocates a machine in its reset state, with tracing off and the fastest interpreter selected
+    // Returns NULL if there is not enough memory
+
+    SmisMachine* m = calloc(1, sizeof(SmisMachine));
+
+    if(!m) return NULL;
+
+    FLAG_RESULT = 0x0001;
+
+    #ifdef SMISEM_THREADED
+    m->engine = SMIS_ENGINE_THREADED;
+    #else
+    m->engine = SMIS_ENGINE_SWITCH;
+    #endif
+
+    m->traceLevel = SMIS_TRACE_NONE;
+    m->traceStream = stdout;
+
+    m->nextBudgetCheck = UINT64_MAX;
+
+    return m;
+
+}
+
+void smisDestroy(SmisMachine* m) {
+    // Releases a machine and its code buffer
+
+    #ifdef SMISEM_JIT
+    if(JIT_CODE) munmap(JIT_CODE, JIT_CODE_SIZE);
+    #endif
+
+    free(m->profile);
+    free(m);
+
+}
+
+void smisReset(SmisMachine* m) {
+    // Clears memory, registers, flags and every cache, keeping the engine and trace settings
+    // Only the pages touched since the last reset are cleared, so resetting after a small program is cheap
+
+    for(int page = 0; page < m->touchedPageCount; page++) {
+
+        uint16_t start = m->touchedPageList[page] << PAGE_SHIFT;
+
+        memset(&MEM[start], 0, PAGE_WORDS * sizeof(MEM[0]));
+        memset(&DECODE_CACHE[start], 0, PAGE_WORDS * sizeof(DECODE_CACHE[0]));
+
+        m->touchedPages[m->touchedPageList[page]] = false;
+
+    }
+
+    m->touchedPageCount = 0;
+
+    clearDirtyPages(m);
+
+    m->forkParent = NULL;
+    m->memoryVersion = ++MEMORY_VERSIONS;
+
+    flushCodeCaches(m);
+    memset(CODE_PAGE_STATE, 0, sizeof(CODE_PAGE_STATE));
+
+    memset(REG, 0, sizeof(REG));
+    PC = 0;
+    IR = 0;
+    FLAG_RESULT = 0x0001;
+    m->status = SMIS_STATUS_RUNNING;
+
+    m->steps = 0;
+    m->segmentStart = 0;
+
+    if(m->profile) memset(m->profile, 0, sizeof(Profile));
+
+}
+
+bool smisLoad(SmisMachine* m, const uint8_t* image, size_t size) {
+    // Resets the machine and places a program image (the contents of a .bin file) in memory, starting at address 0
+    // Returns false if the image does not fit in memory along with the HALT appended after it
+
+    if(size / 4 >= 0x8000) return false;
+
+    smisReset(m);
+
+    uint16_t endAddr = size / 4 * 2;
+
+    #ifdef SMISEM_SIMD
+    if(__builtin_cpu_supports("ssse3")) copyImageSsse3(MEM, image, endAddr);
+    else copyImage(MEM, image, endAddr);
+    #else
+    copyImage(MEM, image, endAddr);
+    #endif
+    // Every instruction is stored big-endian, as two 16-bit segments
+
+    MEM[endAddr] = OP_HALT << 8;
+    // Add a HALT to the end, in case the ASM programmer forgot to do so
+
+    for(uint32_t addr = 0; addr <= endAddr; addr += PAGE_WORDS) touchPage(m, addr);
+
+    predecodeProgram(m, endAddr);
+
+    return true;
+
+}
+
+bool smisLoadFile(SmisMachine* m, const char* binfile) {
+    // Loads the program image in a .bin file, mapping it straight into the loader instead of reading it into a buffer
+    // Returns false if the file cannot be opened or is too large
+
+    int program;
+    struct stat info;
+
+    if((program = open(binfile, O_RDONLY)) < 0) return false;
+
+    if(fstat(program, &info) < 0 || !S_ISREG(info.st_mode) || info.st_size / 4 >= 0x8000) {
+
+        close(program);
+        return false;
+
+    }
+    // The size is checked once here, pipes and devices cannot be mapped and are not accepted
+
+    if(info.st_size <= LOAD_READ_MAX) {
+
+        uint8_t buffer[LOAD_READ_MAX];
+        bool loaded = read(program, buffer, info.st_size) == info.st_size && smisLoad(m, buffer, info.st_size);
+
+        close(program);
+        return loaded;
+
+    }
+    // Mapping and unmapping costs more than one read for small programs
+
+    uint8_t* image = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, program, 0);
+
+    close(program);
+
+    if(image == MAP_FAILED) return false;
+
+    bool loaded = smisLoad(m, image, info.st_size);
+
+    munmap(image, info.st_size);
+
+    return loaded;
+
+}
+
+bool smisEngineAvailable(uint8_t engine) {
+    // Checks if a given engine is part of this build
+
+    switch(engine) {
+
+        case SMIS_ENGINE_SWITCH: case SMIS_ENGINE_BLOCKS: return true;
+
+        #ifdef SMISEM_THREADED
+        case SMIS_ENGINE_THREADED: return true;
+        #endif
+
+        #ifdef SMISEM_JIT
+        case SMIS_ENGINE_JIT: return true;
+        #endif
+
+        default: return false;
+
+    }
+
+}
+
+bool smisSetEngine(SmisMachine* m, uint8_t engine) {
+    // Selects the engine used by untraced, unlimited runs
+    // Returns false if the engine is not part of this build
+
+    if(!smisEngineAvailable(engine)) return false;
+
+    m->engine = engine;
+
+    return true;
+
+}
+
+void smisSetTrace(SmisMachine* m, uint8_t level, FILE* stream) {
+    // Sets the trace level and the stream trace lines are written to
+
+    m->traceLevel = level > SMIS_TRACE_BINARY ? SMIS_TRACE_BINARY : level;
+    m->traceStream = stream;
+
+}
+
+void smisSetTraceSink(SmisMachine* m, SmisTraceSink sink, void* context) {
+    // Sends binary trace chunks to a function instead of the trace stream, a NULL sink goes back to the stream
+
+    m->traceSink = sink;
+    m->traceContext = context;
+
+}
+
+void smisSetBudget(SmisMachine* m, uint64_t maxSteps, uint64_t maxMilliseconds) {
+    // Limits every following run to roughly maxSteps instructions and maxMilliseconds of wall-clock time, 0 means no limit
+    // Budgets are checked at jumps, so a run can only go past one by the length of a single straight line of code,
+    // and a step budget always stops a given program at the same place
+
+    m->budgetSteps = maxSteps;
+    m->budgetTime = maxMilliseconds;
+
+}
+
+void smisSetBreakpoint(SmisMachine* m, bool enabled, uint16_t addr) {
+    // Stops following runs whenever a jump (taken or not) lands on addr, or turns the breakpoint off
+    // Every jump leaves translated code while a breakpoint is set, so runs are slower until it is turned off again
+
+    m->breakpointSet = enabled;
+    m->breakpoint = addr;
+
+    if(!HALTED) setNextBudgetCheck(m);
+
+}
+
+uint8_t smisRun(SmisMachine* m, uint64_t maxSteps) {
+    // Runs the machine until it stops, or for at most maxSteps instructions if maxSteps is nonzero
+    // Returns the status afterwards, which is still SMIS_STATUS_RUNNING if the step limit was reached
+    // Step-limited and traced runs go through the interpreter one instruction at a time, unlike budgets
+
+    if(m->status == SMIS_STATUS_BUDGET_EXHAUSTED || m->status == SMIS_STATUS_BREAKPOINT) m->status = SMIS_STATUS_RUNNING;
+
+    if(HALTED) return m->status;
+
+    m->memoryVersion = ++MEMORY_VERSIONS;
+    // Machines forked from this one cannot rely on its memory being the same after the run
+
+    m->segmentStart = PC;
+    m->stepLimit = m->budgetSteps ? m->steps + m->budgetSteps : UINT64_MAX;
+    m->deadline = m->budgetTime ? getTimeNs() + m->budgetTime * 1000000 : 0;
+
+    setNextBudgetCheck(m);
+
+    if(!maxSteps && m->traceLevel == SMIS_TRACE_NONE) executeProgram(m);
+    else {
+
+        for(uint64_t step = 0; !HALTED && (!maxSteps || step < maxSteps); step++) {
+
+            uint16_t instructionAddr = PC;
+
+            if(m->traceLevel != SMIS_TRACE_NONE) grabNextInstruction(m);
+
+            if(m->traceLevel == SMIS_TRACE_BINARY && !m->traceChunkUsed) startTraceChunk(m);
+
+            interpretInstruction(m);
+
+            if(m->traceLevel != SMIS_TRACE_NONE && m->status != SMIS_STATUS_UNKNOWN_INSTRUCTION
+                && m->status != SMIS_STATUS_DIVIDE_BY_ZERO) {
+
+                traceInstruction(m, instructionAddr);
+
+            }
+            // An instruction that failed was never executed, but a jump that used up the budget was
+
+        }
+
+    }
+
+    m->steps += (uint16_t) (PC - m->segmentStart) / 2;
+    if(m->profile && PC != m->segmentStart) profileSegment(m, PC);
+    m->segmentStart = PC;
+    // Count the straight line of code since the last jump, which stops at PC whatever the machine stopped for
+
+    flushTrace(m);
+    // Every run leaves a complete trace behind it
+
+    return m->status;
+
+}
+uint8_t smisRunToStep(SmisMachine* m, uint64_t step) {
+    // Runs the machine until exactly step instructions have been executed since the program was loaded, ignoring
+    // budgets, or until it stops before that
+    // Returns the status afterwards, which is SMIS_STATUS_RUNNING if the step was reached
+
+    uint64_t budgetSteps = m->budgetSteps;
+    uint64_t budgetTime = m->budgetTime;
+
+    m->budgetTime = 0;
+
+    if(step > m->steps + SEEK_STEP_MARGIN) {
+
+        m->budgetSteps = step - SEEK_STEP_MARGIN - m->steps;
+
+        if(smisRun(m, 0) == SMIS_STATUS_BUDGET_EXHAUSTED) m->status = SMIS_STATUS_RUNNING;
+
+    }
+
+    m->budgetSteps = 0;
+
+    if(!HALTED && step > m->steps) smisRun(m, step - m->steps);
+
+    m->budgetSteps = budgetSteps;
+    m->budgetTime = budgetTime;
+
+    return m->status;
+
+}
+
+uint8_t smisGetStatus(SmisMachine* m) {
+    // Returns whether the machine is still running, or why it stopped
+
+    return m->status;
+
+}
+
+uint64_t smisGetSteps(SmisMachine* m) {
+    // Returns the number of instructions executed since the program was loaded, not counting one that failed
+
+    return m->steps;
+
+}
+
+bool smisSetProfiling(SmisMachine* m, bool enabled) {
+    // Turns profiling on or off, counts start from zero each time it is turned on and at every load
+    // Returns false if the counters cannot be allocated
+
+    if(enabled == !!m->profile) return true;
+
+    if(enabled && !(m->profile = calloc(1, sizeof(Profile)))) return false;
+
+    if(!enabled) {
+
+        free(m->profile);
+        m->profile = NULL;
+
+    }
+
+    flushCodeCaches(m);
+    // Translated code only counts for the profiler if it was translated with profiling on
+
+    return true;
+
+}
+
+bool smisGetProfile(SmisMachine* m, SmisProfile* profile) {
+    // Fills in a profile from the counters collected since the program was loaded
+    // Returns false if profiling is off
+
+    if(!m->profile) return false;
+
+    memset(profile, 0, sizeof(SmisProfile));
+
+    for(int parity = 0; parity < 2; parity++) {
+
+        int64_t running = m->profile->segments[0x10000 + parity];
+
+        for(uint32_t addr = parity; addr < 0x10000; addr += 2) {
+
+            running += m->profile->segments[addr];
+            profile->executions[addr] = running;
+
+        }
+
+    }
+
+    for(uint32_t addr = 0; addr < 0x10000; addr++) {
+
+        if(!profile->executions[addr]) continue;
+
+        uint8_t opcode = smisGetOpcode(m, addr);
+
+        profile->opcodes[opcode] += profile->executions[addr];
+
+        if(opcode == OP_JUMP_IF_ZERO || opcode == OP_JUMP_IF_NOTZERO) {
+
+            profile->taken[addr] = m->profile->taken[addr];
+            profile->notTaken[addr] = profile->executions[addr] - m->profile->taken[addr];
+
+        }
+
+    }
+
+    return true;
+
+}
+
+const char* smisMnemonic(uint8_t opcode) {
+    // Returns the mnemonic of an opcode, or NULL if there is no such instruction
+
+    return opcode < sizeof(MNEMONICS) / sizeof(MNEMONICS[0]) ? MNEMONICS[opcode] : NULL;
+
+}
+
+bool smisSaveSnapshot(SmisMachine* m, const char* file) {
+    // Writes the registers, flags, PC, status, step count and every page of memory that is not all zero to a file
+    // Returns false if the file cannot be written
+
+    SnapshotHeader header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+
+    header.version = SMIS_SNAPSHOT_VERSION;
+    memcpy(header.registers, REG, sizeof(REG));
+    header.programCounter = PC;
+    header.flagResult = FLAG_RESULT;
+    header.status = m->status;
+    header.steps = m->steps;
+
+    for(int page = 0; page < m->touchedPageCount; page++) {
+
+        uint16_t* start = &MEM[m->touchedPageList[page] << PAGE_SHIFT];
+
+        for(int word = 0; word < PAGE_WORDS; word++) {
+
+            if(start[word]) {
+
+                header.pages[header.pageCount++] = m->touchedPageList[page];
+                break;
+
+            }
+
+        }
+
+    }
+    // Untouched pages are known to be zero, so only touched pages have to be looked at
+
+    FILE* snapshot = fopen(file, "wb");
+
+    if(!snapshot) return false;
+
+    bool written = fwrite(&header, sizeof(header), 1, snapshot) == 1;
+
+    for(int page = 0; written && page < header.pageCount; page++) {
+
+        written = fwrite(&MEM[header.pages[page] << PAGE_SHIFT], PAGE_WORDS * sizeof(MEM[0]), 1, snapshot) == 1;
+
+    }
+
+    return fclose(snapshot) == 0 && written;
+
+}
+
+bool smisLoadSnapshot(SmisMachine* m, const char* file) {
+    // Resets the machine and restores the state saved in a snapshot file, mapping the file instead of reading it
+    // Returns false if the file cannot be opened or is not a snapshot written by this version, leaving the machine reset
+
+    int snapshot;
+    struct stat info;
+
+    if((snapshot = open(file, O_RDONLY)) < 0) return false;
+
+    if(fstat(snapshot, &info) < 0 || !S_ISREG(info.st_mode) || info.st_size < (off_t) sizeof(SnapshotHeader)) {
+
+        close(snapshot);
+        return false;
+
+    }
+
+    uint8_t* contents = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, snapshot, 0);
+
+    close(snapshot);
+
+    if(contents == MAP_FAILED) return false;
+
+    SnapshotHeader* header = (SnapshotHeader*) contents;
+    uint16_t* pages = (uint16_t*) (contents + sizeof(SnapshotHeader));
+
+    smisReset(m);
+
+    bool valid = !memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) && header->version == SMIS_SNAPSHOT_VERSION
+        && header->pageCount <= PAGE_COUNT
+        && info.st_size == (off_t) (sizeof(SnapshotHeader) + header->pageCount * PAGE_WORDS * sizeof(MEM[0]));
+
+    if(valid) {
+
+        for(int page = 0; page < header->pageCount; page++) {
+
+            memcpy(&MEM[header->pages[page] << PAGE_SHIFT], &pages[page * PAGE_WORDS], PAGE_WORDS * sizeof(MEM[0]));
+            touchPage(m, header->pages[page] << PAGE_SHIFT);
+
+        }
+        // Instructions are decoded on first use, since any page may hold code
+
+        memcpy(REG, header->registers, sizeof(REG));
+        PC = header->programCounter;
+        FLAG_RESULT = header->flagResult;
+        m->status = header->status;
+        m->steps = header->steps;
+        m->segmentStart = PC;
+
+    }
+
+    munmap(contents, info.st_size);
+
+    return valid;
+
+}
+
+void smisFork(SmisMachine* m, SmisMachine* parent) {
+    // Makes a machine an exact copy of the memory, registers, flags, PC, status and step count of another, keeping its
+    // own engine, trace, budget and breakpoint settings
+    // Forking again from the same parent while the parent has not changed only copies back the pages the machine has
+    // written to since, and keeps its cached and translated code unless that code was written to
+
+    if(m->forkParent == parent && m->forkVersion == parent->memoryVersion) {
+
+        bool codeWritten = false;
+
+        for(int page = 0; page < m->dirtyPageCount; page++) {
+
+            uint8_t dirtyPage = m->dirtyPageList[page];
+
+            copyPage(m, parent, dirtyPage);
+
+            DECODE_CACHE[(uint16_t) ((dirtyPage << PAGE_SHIFT) - 1)] = parent->decodeCache[(uint16_t) ((dirtyPage << PAGE_SHIFT) - 1)];
+            // The instruction before the page overlaps its first word
+
+            if(CODE_PAGE_STATE[dirtyPage] == CODE_PAGE_CACHED) codeWritten = true;
+            if(CODE_PAGE_STATE[dirtyPage] == CODE_PAGE_UNCACHED) CODE_PAGE_STATE[dirtyPage] = CODE_PAGE_NONE;
+
+        }
+
+        if(codeWritten) flushCodeCaches(m);
+
+    } else {
+
+        smisReset(m);
+
+        for(int page = 0; page < parent->touchedPageCount; page++) {
+
+            copyPage(m, parent, parent->touchedPageList[page]);
+            touchPage(m, parent->touchedPageList[page] << PAGE_SHIFT);
+
+        }
+        // Every other page is zero in both machines, and so is every decode cache entry outside the touched pages
+
+    }
+
+    clearDirtyPages(m);
+
+    memcpy(REG, parent->registers, sizeof(REG));
+    PC = parent->programCounter;
+    IR = parent->instructionRegister;
+    FLAG_RESULT = parent->flagResult;
+    m->status = parent->status;
+    m->steps = parent->steps;
+    m->segmentStart = PC;
+
+    if(m->profile) memset(m->profile, 0, sizeof(Profile));
+
+    m->forkParent = parent;
+    m->forkVersion = parent->memoryVersion;
+    m->memoryVersion = ++MEMORY_VERSIONS;
+
+}
+
+uint16_t smisGetRegister(SmisMachine* m, uint8_t reg) {
+    // Returns the value of a register
+
+    return REG[reg & 0xF];
+
+}
+
+void smisSetRegister(SmisMachine* m, uint8_t reg, uint16_t value) {
+    // Sets the value of a register
+
+    REG[reg & 0xF] = value;
+
+}
+
+uint16_t smisGetPC(SmisMachine* m) {
+    // Returns the address of the next instruction to run
+
+    return PC;
+
+}
+
+void smisSetPC(SmisMachine* m, uint16_t addr) {
+    // Moves execution to a given address, which also lets a stopped machine run again
+
+    PC = addr;
+    m->segmentStart = addr;
+    m->status = SMIS_STATUS_RUNNING;
+
+}
+
+bool smisGetZeroFlag(SmisMachine* m) {
+    // Returns the zero flag
+
+    return ZF;
+
+}
+
+bool smisGetSignFlag(SmisMachine* m) {
+    // Returns the sign flag
+
+    return SF;
+
+}
+
+uint16_t smisReadMemory(SmisMachine* m, uint16_t addr) {
+    // Returns a word of memory
+
+    return MEM[addr];
+
+}
+
+uint8_t smisGetOpcode(SmisMachine* m, uint16_t addr) {
+    // Returns the opcode of the instruction at a given address, which is HALT for an all-zero instruction
+
+    uint32_t instruction = (uint32_t) MEM[addr] << 16 | MEM[(uint16_t) (addr + 1)];
+
+    return instruction ? getOpcode(instruction) : OP_HALT;
+
+}
+
+void smisWriteMemory(SmisMachine* m, uint16_t addr, uint16_t value) {
+    // Writes a word of memory, in the same way as a STORE instruction
+
+    writeMemory(m, addr, value);
+
+    m->memoryVersion = ++MEMORY_VERSIONS;
+
+}
+
+uint32_t smisMemoryChecksum(SmisMachine* m) {
+    // Returns the FNV-1a hash of the whole memory array, so runs on different engines can be compared
+    // Untouched pages are all zero, and hashing a zero word only multiplies by the FNV prime, so each untouched page
+    // takes a single multiplication
+
+    uint32_t zeroPageFactor = 1;
+
+    for(int word = 0; word < PAGE_WORDS; word++) zeroPageFactor *= 0x01000193;
+
+    uint32_t checksum = 0x811C9DC5;
+
+    for(uint32_t page = 0; page < PAGE_COUNT; page++) {
+
+        if(!m->touchedPages[page]) {
+
+            checksum *= zeroPageFactor;
+            continue;
+
+        }
+
+        for(uint32_t addr = page << PAGE_SHIFT; addr < (page + 1) << PAGE_SHIFT; addr++) {
+
+            checksum = (checksum ^ MEM[addr]) * 0x01000193;
+
+        }
+
+    }
+
+    return checksum;
+
+}
+
+static void copyImage(uint16_t* words, const uint8_t* image, uint32_t count) {
+    // Copies count big-endian 16-bit words from a program image into memory
+
+    for(uint32_t i = 0; i < count; i++) words[i] = image[i * 2] << 8 | image[i * 2 + 1];
+
+}
+
+#ifdef SMISEM_SIMD
+__attribute__((target("ssse3")))
+static void copyImageSsse3(uint16_t* words, const uint8_t* image, uint32_t count) {
+    // Copies a program image into memory like copyImage, swapping the bytes of 8 words at once with one PSHUFB
+
+    const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    uint32_t i = 0;
+
+    for(; i + 8 <= count; i += 8) {
+
+        __m128i chunk = _mm_loadu_si128((const __m128i*) (image + i * 2));
+        _mm_storeu_si128((__m128i*) (words + i), _mm_shuffle_epi8(chunk, swap));
+
+    }
+
+    copyImage(words + i, image + i * 2, count - i);
+    // The last few words of an image that is not a multiple of 16 bytes
+
+}
+#endif
+
+static void predecodeProgram(SmisMachine* m, uint16_t endAddr) {
+    // Fills the decode cache for every instruction of the loaded program, up to and including the appended HALT
+    // Addresses outside of the program (jumps into data, odd addresses) are still decoded lazily on first use
+
+    for(uint32_t addr = 0; addr <= endAddr; addr += 2) decodeInstruction(m, addr);
+
+}
+
+static void executeProgram(SmisMachine* m) {
+    // Calls each instruction in the program until reaching a HALT signal, using the selected engine
+
+    #ifdef SMISEM_JIT
+    if(m->engine == SMIS_ENGINE_JIT && jitInit(m)) {
+
+        executeJit(m);
+        return;
+
+    }
+    #endif
+
+    if(m->engine == SMIS_ENGINE_BLOCKS) {
+
+        executeBlocks(m);
+        return;
+
+    }
+
+    #ifdef SMISEM_THREADED
+    if(m->engine != SMIS_ENGINE_SWITCH) {
+
+        executeThreaded(m);
+        return;
+
+    }
+    #endif
+
+    do {
+
+        DecodedInstruction* d = &DECODE_CACHE[PC];
+
+        PC += 2;
+        // PC is incremented prior to executing instruction so it does not interfere with J-Type instructions
+        executeDecoded(m, d);
+
+        RZR = 0x0000;
+
+    } while(!HALTED);
+
+}
+
+#ifdef SMISEM_THREADED
+#define DISPATCH_TABLE { \
+    [0 ... 0xFF] = &&invalid, \
+    [OP_UNDECODED] = &&undecoded, \
+    [OP_SET] = &&set, [OP_COPY] = &&copy, \
+    [OP_ADD] = &&add, [OP_SUBTRACT] = &&subtract, [OP_MULTIPLY] = &&multiply, \
+    [OP_DIVIDE] = &&divide, [OP_MODULO] = &&modulo, \
+    [OP_COMPARE] = &&compare, \
+    [OP_SHIFT_LEFT] = &&shiftLeft, [OP_SHIFT_RIGHT] = &&shiftRight, \
+    [OP_AND] = &&and, [OP_OR] = &&or, [OP_XOR] = &&xor, \
+    [OP_NAND] = &&nand, [OP_NOR] = &&nor, [OP_NOT] = &&not, \
+    [OP_ADD_IMM] = &&addImm, [OP_SUBTRACT_IMM] = &&subtractImm, [OP_MULTIPLY_IMM] = &&multiplyImm, \
+    [OP_DIVIDE_IMM] = &&divideImm, [OP_MODULO_IMM] = &&moduloImm, \
+    [OP_COMPARE_IMM] = &&compareImm, \
+    [OP_SHIFT_LEFT_IMM] = &&shiftLeftImm, [OP_SHIFT_RIGHT_IMM] = &&shiftRightImm, \
+    [OP_AND_IMM] = &&andImm, [OP_OR_IMM] = &&orImm, [OP_XOR_IMM] = &&xorImm, \
+    [OP_NAND_IMM] = &&nandImm, [OP_NOR_IMM] = &&norImm, \
+    [OP_LOAD] = &&load, [OP_STORE] = &&store, \
+    [OP_JUMP] = &&jump, [OP_JUMP_IF_ZERO] = &&jumpIfZero, \
+    [OP_JUMP_IF_NOTZERO] = &&jumpIfNotZero, [OP_JUMP_LINK] = &&jumpLink, \
+    [OP_HALT] = &&halt \
+}
+// Label addresses for every handler indexed by opcode, functions using it define their own halt, undecoded and invalid labels
+// (and a divideByZero label for the handlers below)
+
+#define DISPATCH_HANDLERS \
+    set: SET(m, d->rDest, d->iVal); DISPATCH_NEXT(); \
+    copy: COPY(m, d->rDest, d->rOp1); DISPATCH_NEXT(); \
+    \
+    add: ADD(m, d->rDest, d->rOp1, d->rOp2); DISPATCH_NEXT(); \
+    subtract: SUBTRACT(m, d->rDest, d->rOp1, d->rOp2); DISPATCH_NEXT(); \
+    multiply: MULTIPLY(m, d->rDest, d->rOp1, d->rOp2); DISPATCH_NEXT(); \
+    divide: if(!REG[d->rOp2]) goto divideByZero; DIVIDE(m, d->rDest, d->rOp1, d->rOp2); DISPATCH_NEXT(); \
+    modulo: if(!REG[d->rOp2]) goto divideByZero; MODULO(m, d->rDest, d->rOp1, d->rOp2); DISPATCH_NEXT(); \
+    \
+    compare: COMPARE(m, d->rOp1, d->rOp2); DISPATCH_NEXT(); \
+    \
+    shiftLeft: SHIFT_LEFT(m, d->rDest, d->rOp1, d->rOp2); DISPATCH_NEXT(); \
+    shiftRight: SHIFT_RIGHT(m, d->rDest, d->rOp1, d->rOp2); DISPATCH_NEXT(); \
+    \
+    and: AND(m, d->rDest, d->rOp1, d->rOp2); DISPATCH_NEXT(); \
+    or: OR(m, d->rDest, d->rOp1, d->rOp2); DISPATCH_NEXT(); \
+    xor: XOR(m, d->rDest, d->rOp1, d->rOp2); DISPATCH_NEXT(); \
+    nand: NAND(m, d->rDest, d->rOp1, d->rOp2); DISPATCH_NEXT(); \
+    nor: NOR(m, d->rDest, d->rOp1, d->rOp2); DISPATCH_NEXT(); \
+    not: NOT(m, d->rDest, d->rOp1); DISPATCH_NEXT(); \
+    \
+    addImm: ADD_IMM(m, d->rDest, d->rOp1, d->iVal); DISPATCH_NEXT(); \
+    subtractImm: SUBTRACT_IMM(m, d->rDest, d->rOp1, d->iVal); DISPATCH_NEXT(); \
+    multiplyImm: MULTIPLY_IMM(m, d->rDest, d->rOp1, d->iVal); DISPATCH_NEXT(); \
+    divideImm: if(!d->iVal) goto divideByZero; DIVIDE_IMM(m, d->rDest, d->rOp1, d->iVal); DISPATCH_NEXT(); \
+    moduloImm: if(!d->iVal) goto divideByZero; MODULO_IMM(m, d->rDest, d->rOp1, d->iVal); DISPATCH_NEXT(); \
+    \
+    compareImm: COMPARE_IMM(m, d->rOp1, d->iVal); DISPATCH_NEXT(); \
+    \
+    shiftLeftImm: SHIFT_LEFT_IMM(m, d->rDest, d->rOp1, d->iVal); DISPATCH_NEXT(); \
+    shiftRightImm: SHIFT_RIGHT_IMM(m, d->rDest, d->rOp1, d->iVal); DISPATCH_NEXT(); \
+    \
+    andImm: AND_IMM(m, d->rDest, d->rOp1, d->iVal); DISPATCH_NEXT(); \
+    orImm: OR_IMM(m, d->rDest, d->rOp1, d->iVal); DISPATCH_NEXT(); \
+    xorImm: XOR_IMM(m, d->rDest, d->rOp1, d->iVal); DISPATCH_NEXT(); \
+    nandImm: NAND_IMM(m, d->rDest, d->rOp1, d->iVal); DISPATCH_NEXT(); \
+    norImm: NOR_IMM(m, d->rDest, d->rOp1, d->iVal); DISPATCH_NEXT(); \
+    \
+    load: LOAD(m, d->rDest, d->rOp1, d->iVal); DISPATCH_NEXT(); \
+    store: STORE(m, d->rDest, d->rOp1, d->iVal); DISPATCH_NEXT(); \
+    \
+    jump: JUMP(m, d->iVal); DISPATCH_JUMP(); \
+    jumpIfZero: JUMP_IF_ZERO(m, d->iVal); DISPATCH_JUMP(); \
+    jumpIfNotZero: JUMP_IF_NOTZERO(m, d->iVal); DISPATCH_JUMP(); \
+    jumpLink: JUMP_LINK(m, d->iVal); DISPATCH_JUMP();
+// Handler labels shared by the threaded engines, each one ends with the DISPATCH_NEXT() or DISPATCH_JUMP() (which has to
+// stop once a budget is used up) of the function using them
+
+static void executeThreaded(SmisMachine* m) {
+    // Runs the program with direct-threaded dispatch until reaching a HALT signal
+    // Every handler ends in its own indirect jump to the next one, so there is no central switch for branch predictors
+    // to mispredict on, and the small handler functions are inlined into their labels
+
+    static void* const DISPATCH[0x100] = DISPATCH_TABLE;
+
+    DecodedInstruction* d;
+
+    #define DISPATCH_NEXT() RZR = 0x0000; d = &DECODE_CACHE[PC]; PC += 2; goto *DISPATCH[d->opcode]
+    #define DISPATCH_JUMP() if(HALTED) return; DISPATCH_NEXT()
+    // PC is incremented prior to executing instruction so it does not interfere with J-Type instructions
+
+    d = &DECODE_CACHE[PC];
+    PC += 2;
+    goto *DISPATCH[d->opcode];
+
+    DISPATCH_HANDLERS;
+
+    halt: HALT(m); RZR = 0x0000; return;
+
+    undecoded:
+        decodeInstruction(m, d - DECODE_CACHE);
+        goto *DISPATCH[d->opcode];
+
+    invalid: unknownInstruction(m); return;
+
+    divideByZero: divideByZero(m); return;
+
+    #undef DISPATCH_NEXT
+    #undef DISPATCH_JUMP
+
+}
+#endif
+
+#ifdef SMISEM_JIT
+static void executeJit(SmisMachine* m) {
+    // Runs the program by translating basic blocks to x86-64 code on first execution and chaining them together
+    // Blocks exit back here only when a jump target has not been linked yet, on HALT, after a write into translated code,
+    // or at a jump once the step count reaches the next budget check
+
+    uint8_t* exitStub = NULL;
+
+    while(!HALTED) {
+
+        if(CODE_FLUSH_PENDING || JIT_EMIT + JIT_BLOCK_SIZE > JIT_CODE + JIT_CODE_SIZE) {
+
+            flushCodeCaches(m);
+            exitStub = NULL;
+
+        }
+
+        uint8_t* native = JIT_BLOCKS[PC];
+
+        if(!native) {
+
+            Block* block = getBlock(m, PC);
+
+            if(block) native = JIT_BLOCKS[PC] = jitTranslateBlock(m, block);
+
+        }
+
+        if(!native) {
+
+            interpretInstruction(m);
+            exitStub = NULL;
+            continue;
+
+        }
+
+        if(exitStub) jitChain(exitStub, native);
+        exitStub = JIT_ENTER(native);
+
+        if(m->steps >= m->nextBudgetCheck) checkBudget(m);
+
+    }
+
+}
+
+static bool jitInit(SmisMachine* m) {
+    // Maps the code buffer and emits the entry and exit trampolines
+    // Returns false if executable memory is not available, in which case the interpreter is used instead
+
+    if(JIT_CODE) return true;
+
+    JIT_CODE = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(JIT_CODE == MAP_FAILED) {
+
+        JIT_CODE = NULL;
+        return false;
+
+    }
+
+    JIT_EMIT = JIT_CODE;
+
+    JIT_ENTER = (uint8_t* (*)(uint8_t*)) JIT_EMIT;
+    EMIT(0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);
+    // push rbx, r12, r13, r14, r15 (five pushes also leave the stack 16-byte aligned for helper calls, r14 is unused)
+    EMIT(0x48, 0xBB); jitEmit64(m, (uint64_t) REG);
+    EMIT(0x49, 0xBC); jitEmit64(m, (uint64_t) MEM);
+    EMIT(0x49, 0xBD); jitEmit64(m, (uint64_t) &FLAG_RESULT);
+    EMIT(0x49, 0xBF); jitEmit64(m, (uint64_t) m);
+    // rbx = registers, r12 = memory, r13 = &flagResult, r15 = the machine for the whole time spent in translated code
+    EMIT(0xFF, 0xE7);
+    // jmp rdi
+
+    JIT_EPILOGUE = JIT_EMIT;
+    EMIT(0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3);
+    // pop r15, r14, r13, r12, rbx, ret (the exit stub address is already in rax)
+
+    JIT_BLOCKS_START = JIT_EMIT;
+
+    return true;
+
+}
+
+static uint8_t* jitTranslateBlock(SmisMachine* m, Block* block) {
+    // Translates a cached block into native code and returns its entry point
+
+    uint8_t* native = JIT_EMIT;
+
+    for(int op = 0; op < block->length; op++) {
+
+        if(!jitTranslateInstruction(m, &block->ops[op], block->startAddr + (op + 1) * 2)) return native;
+        // Jumps and HALT end the block with their own exits
+
+    }
+
+    jitEmitExit(m, block->startAddr + block->length * 2);
+    // Blocks cut short by the length limit, an uncached page or an invalid instruction fall through to the next address
+
+    return native;
+
+}
+
+static bool jitTranslateInstruction(SmisMachine* m, DecodedInstruction* d, uint16_t nextAddr) {
+    // Emits native code for a single decoded instruction, using eax/ecx/edx as scratch registers
+    // The code computes the same 16-bit results as the handlers, R0 is simply never written back
+    // Returns false if the instruction ends the block
+
+    switch(d->opcode) {
+
+        case OP_SET:
+            if(d->rDest) { EMIT(0x66, 0xC7, 0x43, d->rDest * 2); jitEmit16(m, d->iVal); }
+            // mov word [rbx + rDest * 2], imm16
+            break;
+
+        case OP_COPY:
+            jitEmitLoadReg(m, 0, d->rOp1);
+            jitEmitStoreResult(m, d->rDest, false);
+            break;
+
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_COMPARE:
+        case OP_SHIFT_LEFT:
+        case OP_SHIFT_RIGHT:
+        case OP_AND:
+        case OP_OR:
+        case OP_XOR:
+        case OP_NAND:
+        case OP_NOR:
+            jitEmitLoadReg(m, 0, d->rOp1);
+            jitEmitLoadReg(m, 1, d->rOp2);
+
+            switch(d->opcode) {
+
+                case OP_ADD: case OP_COMPARE: EMIT(0x01, 0xC8); break;
+                // add eax, ecx (COMPARE adds its operands, the same as the handler)
+                case OP_SUBTRACT: EMIT(0x29, 0xC8); break;
+                case OP_MULTIPLY: EMIT(0x0F, 0xAF, 0xC1); break;
+                case OP_SHIFT_LEFT: EMIT(0xD3, 0xE0); break;
+                case OP_SHIFT_RIGHT: EMIT(0xD3, 0xE8); break;
+                // shl/shr eax, cl mask the count the same way the compiled handlers do on x86-64
+                case OP_AND: case OP_NAND: EMIT(0x21, 0xC8); break;
+                case OP_OR: case OP_NOR: EMIT(0x09, 0xC8); break;
+                case OP_XOR: EMIT(0x31, 0xC8); break;
+
+            }
+
+            if(d->opcode == OP_NAND || d->opcode == OP_NOR) EMIT(0xF7, 0xD0);
+            // not eax
+
+            jitEmitStoreResult(m, d->opcode == OP_COMPARE ? 0 : d->rDest, true);
+            break;
+
+        case OP_DIVIDE:
+        case OP_MODULO:
+        case OP_DIVIDE_IMM:
+        case OP_MODULO_IMM:
+            jitEmitLoadReg(m, 0, d->rOp1);
+
+            if(d->opcode == OP_DIVIDE || d->opcode == OP_MODULO) {
+
+                jitEmitLoadReg(m, 1, d->rOp2);
+                EMIT(0x85, 0xC9, 0x75, JIT_STOP_LEN);
+                // test ecx, ecx; jnz over the stop
+                jitEmitStop(m, SMIS_STATUS_DIVIDE_BY_ZERO, nextAddr - 2);
+
+            } else if(!d->iVal) {
+
+                jitEmitStop(m, SMIS_STATUS_DIVIDE_BY_ZERO, nextAddr - 2);
+                return false;
+
+            } else { EMIT(0xB9); jitEmit32(m, d->iVal); }
+            // mov ecx, imm32
+
+            EMIT(0x31, 0xD2, 0xF7, 0xF1);
+            // xor edx, edx; div ecx
+
+            if(d->opcode == OP_MODULO || d->opcode == OP_MODULO_IMM) EMIT(0x89, 0xD0);
+            // mov eax, edx
+
+            jitEmitStoreResult(m, d->rDest, true);
+            break;
+
+        case OP_NOT:
+            jitEmitLoadReg(m, 0, d->rOp1);
+            EMIT(0xF7, 0xD0);
+            jitEmitStoreResult(m, d->rDest, true);
+            break;
+
+        case OP_ADD_IMM:
+        case OP_SUBTRACT_IMM:
+        case OP_MULTIPLY_IMM:
+        case OP_COMPARE_IMM:
+        case OP_AND_IMM:
+        case OP_OR_IMM:
+        case OP_XOR_IMM:
+        case OP_NAND_IMM:
+        case OP_NOR_IMM:
+            jitEmitLoadReg(m, 0, d->rOp1);
+
+            switch(d->opcode) {
+
+                case OP_ADD_IMM: EMIT(0x05); break;
+                case OP_SUBTRACT_IMM: case OP_COMPARE_IMM: EMIT(0x2D); break;
+                case OP_MULTIPLY_IMM: EMIT(0x69, 0xC0); break;
+                case OP_AND_IMM: case OP_NAND_IMM: EMIT(0x25); break;
+                case OP_OR_IMM: case OP_NOR_IMM: EMIT(0x0D); break;
+                case OP_XOR_IMM: EMIT(0x35); break;
+
+            }
+
+            jitEmit32(m, d->iVal);
+            // <op> eax, imm32
+
+            if(d->opcode == OP_NAND_IMM || d->opcode == OP_NOR_IMM) EMIT(0xF7, 0xD0);
+
+            jitEmitStoreResult(m, d->opcode == OP_COMPARE_IMM ? 0 : d->rDest, true);
+            break;
+
+        case OP_SHIFT_LEFT_IMM:
+        case OP_SHIFT_RIGHT_IMM:
+            jitEmitLoadReg(m, 0, d->rOp1);
+            EMIT(0xB9); jitEmit32(m, d->iVal);
+
+            if(d->opcode == OP_SHIFT_LEFT_IMM) EMIT(0xD3, 0xE0);
+            else EMIT(0xD3, 0xE8);
+
+            jitEmitStoreResult(m, d->rDest, true);
+            break;
+
+        case OP_LOAD:
+            jitEmitLoadReg(m, 0, d->rOp1);
+            EMIT(0x05); jitEmit32(m, d->iVal);
+            EMIT(0x0F, 0xB7, 0xC0);
+            // movzx eax, ax wraps the address to 16 bits
+            EMIT(0x41, 0x0F, 0xB7, 0x04, 0x44);
+            // movzx eax, word [r12 + rax * 2]
+            jitEmitStoreResult(m, d->rDest, false);
+            break;
+
+        case OP_STORE:
+            jitEmitLoadReg(m, 0, d->rOp1);
+            EMIT(0x05); jitEmit32(m, d->iVal);
+            EMIT(0x89, 0xC2);
+            // mov edx, eax
+            jitEmitLoadReg(m, 6, d->rDest);
+            // movzx esi, word [rbx + rSrc * 2]
+            EMIT(0x4C, 0x89, 0xFF);
+            // mov rdi, r15
+            EMIT(0x48, 0xB8); jitEmit64(m, (uint64_t) jitStore);
+            EMIT(0xFF, 0xD0, 0x85, 0xC0, 0x74, JIT_EXIT_LEN);
+            // call jitStore; test eax, eax; jz over the exit
+            jitEmitExit(m, nextAddr);
+            // Leave the block straight away if the write hit translated code
+            break;
+
+        case OP_JUMP:
+            jitEmitCountSegment(m, nextAddr);
+            jitEmitJumpExit(m, d->iVal);
+            return false;
+
+        case OP_JUMP_IF_ZERO:
+        case OP_JUMP_IF_NOTZERO:
+            jitEmitCountSegment(m, nextAddr);
+            EMIT(0x66, 0x41, 0x83, 0x7D, 0x00, 0x00);
+            // cmp word [r13], 0
+            EMIT(d->opcode == OP_JUMP_IF_ZERO ? 0x75 : 0x74,
+                JIT_JUMP_EXIT_LEN + (m->profile && d->iVal != nextAddr ? JIT_PROFILE_TAKEN_LEN : 0));
+            // jne/je over the taken exit
+
+            if(m->profile && d->iVal != nextAddr) {
+
+                EMIT(0x48, 0xB9); jitEmit64(m, (uint64_t) &m->profile->taken[(uint16_t) (nextAddr - 2)]);
+                EMIT(0x48, 0xFF, 0x01);
+                // mov rcx, &taken[jump address]; inc qword [rcx]
+
+            }
+
+            jitEmitJumpExit(m, d->iVal);
+            jitEmitJumpExit(m, nextAddr);
+            return false;
+
+        case OP_JUMP_LINK:
+            EMIT(0x66, 0xC7, 0x43, 0xD * 2); jitEmit16(m, nextAddr);
+            // mov word [rbx + RLR * 2], imm16
+            jitEmitCountSegment(m, nextAddr);
+            jitEmitJumpExit(m, d->iVal);
+            return false;
+
+        case OP_HALT:
+            jitEmitStop(m, SMIS_STATUS_HALTED, nextAddr);
+            return false;
+
+    }
+
+    return true;
+
+}
+
+static void jitEmitExit(SmisMachine* m, uint16_t targetAddr) {
+    // Emits a block exit to a given SMIS address
+    // The leading jump initially falls through to the exit code, and is patched to jump straight to the target
+    // block once it has been translated
+
+    uint8_t* stub = JIT_EMIT;
+
+    EMIT(0xE9, 0x00, 0x00, 0x00, 0x00);
+    // jmp +0
+    EMIT(0x48, 0xB8); jitEmit64(m, (uint64_t) &PC);
+    EMIT(0x66, 0xC7, 0x00); jitEmit16(m, targetAddr);
+    // PC = targetAddr
+    EMIT(0x48, 0x8D, 0x05); jitEmit32(m, stub - (JIT_EMIT + 4));
+    // lea rax, [stub]
+    EMIT(0xE9); jitEmit32(m, JIT_EPILOGUE - (JIT_EMIT + 4));
+    // jmp epilogue
+
+}
+
+static void jitEmitStop(SmisMachine* m, uint8_t status, uint16_t addr) {
+    // Emits code that stops the machine with a given status and PC, always JIT_STOP_LEN bytes long
+
+    EMIT(0x48, 0xB8); jitEmit64(m, (uint64_t) &m->status);
+    EMIT(0xC6, 0x00, status);
+    EMIT(0x48, 0xB8); jitEmit64(m, (uint64_t) &PC);
+    EMIT(0x66, 0xC7, 0x00); jitEmit16(m, addr);
+    // status = status; PC = addr
+    EMIT(0x31, 0xC0, 0xE9); jitEmit32(m, JIT_EPILOGUE - (JIT_EMIT + 4));
+    // xor eax, eax; jmp epilogue
+
+}
+
+static void jitEmitCountSegment(SmisMachine* m, uint16_t nextAddr) {
+    // Emits the step counting (and profiling, if it is on) done by takeJump() for a jump followed by nextAddr, leaving
+    // the new step count in rdx
+
+    EMIT(0x41, 0x0F, 0xB7, 0x87); jitEmit32(m, offsetof(SmisMachine, segmentStart));
+    // movzx eax, word [r15 + segmentStart]
+    EMIT(0xBA); jitEmit32(m, nextAddr);
+    EMIT(0x29, 0xC2, 0x0F, 0xB7, 0xD2, 0xD1, 0xEA);
+    // mov edx, nextAddr; sub edx, eax; movzx edx, dx; shr edx, 1
+    EMIT(0x49, 0x03, 0x97); jitEmit32(m, offsetof(SmisMachine, steps));
+    EMIT(0x49, 0x89, 0x97); jitEmit32(m, offsetof(SmisMachine, steps));
+    // add rdx, [r15 + steps]; mov [r15 + steps], rdx
+
+    if(!m->profile) return;
+
+    EMIT(0x48, 0xB9); jitEmit64(m, (uint64_t) m->profile->segments);
+    EMIT(0x48, 0xFF, 0x04, 0xC1);
+    EMIT(0x48, 0xFF, 0x89); jitEmit32(m, nextAddr * 8);
+    // mov rcx, segments; inc qword [rcx + rax * 8]; dec qword [rcx + nextAddr * 8]
+    EMIT(0x3D); jitEmit32(m, nextAddr);
+    EMIT(0x72, 0x07, 0x48, 0xFF, 0x81); jitEmit32(m, (0x10000 + (nextAddr & 1)) * 8);
+    // cmp eax, nextAddr; jb over the wrap count; inc qword [rcx + wrap count]
+
+}
+
+static void jitEmitJumpExit(SmisMachine* m, uint16_t targetAddr) {
+    // Emits a block exit for one way out of a jump, always JIT_JUMP_EXIT_LEN bytes long
+    // The exit goes back to executeJit() unchained once the step count in rdx reaches the next budget check
+
+    EMIT(0x66, 0x41, 0xC7, 0x87); jitEmit32(m, offsetof(SmisMachine, segmentStart)); jitEmit16(m, targetAddr);
+    // mov word [r15 + segmentStart], targetAddr
+    EMIT(0x49, 0x3B, 0x97); jitEmit32(m, offsetof(SmisMachine, nextBudgetCheck));
+    EMIT(0x72, JIT_STOP_LEN);
+    // cmp rdx, [r15 + nextBudgetCheck]; jb over the stop
+    jitEmitStop(m, SMIS_STATUS_RUNNING, targetAddr);
+    jitEmitExit(m, targetAddr);
+
+}
+
+static void jitEmitLoadReg(SmisMachine* m, uint8_t hostReg, uint8_t reg) {
+    // Emits movzx <host register>, word [rbx + reg * 2]
+
+    EMIT(0x0F, 0xB7, 0x43 | hostReg << 3, reg * 2);
+
+}
+
+static void jitEmitStoreResult(SmisMachine* m, uint8_t rDest, bool setsFlags) {
+    // Emits code that records the 16-bit result in ax for the flags and writes it back to a register
+    // A destination of R0 discards the result, as resetting RZR after the instruction would
+
+    if(setsFlags) EMIT(0x66, 0x41, 0x89, 0x45, 0x00);
+    // mov word [r13], ax
+
+    if(rDest) EMIT(0x66, 0x89, 0x43, rDest * 2);
+    // mov word [rbx + rDest * 2], ax
+
+}
+
+static void jitEmitBytes(SmisMachine* m, uint8_t* bytes, int count) {
+    // Appends raw bytes to the code buffer
+
+    memcpy(JIT_EMIT, bytes, count);
+    JIT_EMIT += count;
+
+}
+
+static void jitEmit16(SmisMachine* m, uint16_t n) {
+    // Appends a little-endian 16-bit value to the code buffer
+
+    jitEmitBytes(m, (uint8_t*) &n, 2);
+
+}
+
+static void jitEmit32(SmisMachine* m, uint32_t n) {
+    // Appends a little-endian 32-bit value to the code buffer
+
+    jitEmitBytes(m, (uint8_t*) &n, 4);
+
+}
+
+static void jitEmit64(SmisMachine* m, uint64_t n) {
+    // Appends a little-endian 64-bit value to the code buffer
+
+    jitEmitBytes(m, (uint8_t*) &n, 8);
+
+}
+
+static void jitChain(uint8_t* exitStub, uint8_t* block) {
+    // Links a block exit directly to its target block so later runs never leave translated code
+
+    int32_t offset = block - (exitStub + 5);
+
+    memcpy(exitStub + 1, &offset, 4);
+
+}
+
+static int jitStore(SmisMachine* m, uint16_t value, uint16_t addr) {
+    // Performs a STORE on behalf of translated code
+    // Returns nonzero if the write modified translated code, in which case the block has to exit
+
+    writeMemory(m, addr, value);
+
+    return CODE_FLUSH_PENDING;
+
+}
+#endif
+
+static void executeBlocks(SmisMachine* m) {
+    // Runs the program one cached basic block at a time
+    // Each block remembers its successors, so the loop only looks blocks up by address the first time an exit is taken
+
+    Block* block = NULL;
+
+    while(!HALTED) {
+
+        if(CODE_FLUSH_PENDING) {
+
+            flushCodeCaches(m);
+            block = NULL;
+
+        }
+
+        Block* next;
+
+        if(block) {
+
+            Block** link = &block->next[PC == (uint16_t) (block->startAddr + block->length * 2)];
+
+            if(!(next = *link)) next = *link = getBlock(m, PC);
+
+        } else next = getBlock(m, PC);
+
+        if(!next) {
+
+            interpretInstruction(m);
+            block = NULL;
+            continue;
+
+        }
+
+        block = next;
+        executeBlock(m, block);
+
+    }
+
+}
+
+static void executeBlock(SmisMachine* m, Block* block) {
+    // Executes every instruction of a block without per-instruction PC bookkeeping
+    // PC is set to the fall-through address up front, which is the value jumps and JUMP-LINK expect to see
+
+    DecodedInstruction* d = block->ops;
+    DecodedInstruction* end = d + block->length;
+
+    PC = block->startAddr + block->length * 2;
+
+    #ifdef SMISEM_THREADED
+    static void* const DISPATCH[0x100] = DISPATCH_TABLE;
+
+    #define DISPATCH_NEXT() RZR = 0x0000; if(++d == end || CODE_FLUSH_PENDING) goto blockEnd; goto *DISPATCH[d->opcode]
+    #define DISPATCH_JUMP() DISPATCH_NEXT()
+    // A jump always ends its block, and the loop in executeBlocks() sees a used-up budget
+
+    goto *DISPATCH[d->opcode];
+
+    DISPATCH_HANDLERS;
+
+    halt: HALT(m); RZR = 0x0000; return;
+
+    undecoded: invalid: unknownInstruction(m);
+    // Blocks never contain either of these
+
+    divideByZero:
+        divideByZero(m);
+        PC = block->startAddr + (d - block->ops) * 2;
+        return;
+    // divideByZero() cannot tell where in the block the divide was
+
+    #undef DISPATCH_NEXT
+    #undef DISPATCH_JUMP
+
+    blockEnd:
+    #else
+    while(d < end) {
+
+        executeDecoded(m, d++);
+
+        RZR = 0x0000;
+
+        if(CODE_FLUSH_PENDING || HALTED) break;
+
+    }
+
+    if(m->status == SMIS_STATUS_DIVIDE_BY_ZERO) {
+
+        PC = block->startAddr + (d - block->ops - 1) * 2;
+        return;
+
+    }
+    #endif
+
+    if(CODE_FLUSH_PENDING) PC = block->startAddr + (d - block->ops) * 2;
+    // A STORE into cached code ends the block right after the write, since the rest of it may be stale
+
+}
+
+static Block* getBlock(SmisMachine* m, uint16_t startAddr) {
+    // Returns the cached block starting at a given address, discovering and caching it on first use
+    // Returns NULL if the instruction at that address has to be run by the interpreter instead
+
+    Block* block = BLOCK_MAP[startAddr];
+
+    if(block) return block;
+
+    if(BLOCK_ARENA_USED + BLOCK_SIZE(BLOCK_MAX_LEN) > sizeof(BLOCK_ARENA)) {
+
+        CODE_FLUSH_PENDING = true;
+        return NULL;
+
+    }
+    // The flush itself waits for the caller, which may still hold pointers into the arena
+
+    block = (Block*) ((uint8_t*) BLOCK_ARENA + BLOCK_ARENA_USED);
+    block->startAddr = startAddr;
+    block->length = 0;
+    block->next[0] = block->next[1] = NULL;
+
+    uint16_t addr = startAddr;
+
+    while(block->length < BLOCK_MAX_LEN) {
+
+        uint8_t page = addr >> PAGE_SHIFT;
+        uint8_t nextPage = (uint16_t) (addr + 1) >> PAGE_SHIFT;
+
+        if(CODE_PAGE_STATE[page] == CODE_PAGE_UNCACHED || CODE_PAGE_STATE[nextPage] == CODE_PAGE_UNCACHED) break;
+
+        DecodedInstruction* d = &DECODE_CACHE[addr];
+
+        if(d->opcode == OP_UNDECODED) decodeInstruction(m, addr);
+        if(d->opcode == OP_INVALID) break;
+        // Invalid instructions are left for the interpreter to report
+
+        CODE_PAGE_STATE[page] = CODE_PAGE_STATE[nextPage] = CODE_PAGE_CACHED;
+
+        block->ops[block->length++] = *d;
+        addr += 2;
+
+        if(d->opcode >= OP_JUMP && d->opcode <= OP_HALT) break;
+
+    }
+
+    if(!block->length) return NULL;
+
+    BLOCK_ARENA_USED += BLOCK_SIZE(block->length);
+    BLOCK_MAP[startAddr] = block;
+
+    return block;
+
+}
+
+static void interpretInstruction(SmisMachine* m) {
+    // Runs the instruction at PC through the interpreter, for code that cannot be cached
+
+    DecodedInstruction* d = &DECODE_CACHE[PC];
+
+    PC += 2;
+    executeDecoded(m, d);
+
+    RZR = 0x0000;
+
+}
+
+static void noteCodeWrite(SmisMachine* m, uint16_t addr) {
+    // Hands the pages touched by a write into cached code over to the interpreter
+    // The flush itself happens between blocks, since the block that did the write may be among the victims
+
+    uint8_t page = addr >> PAGE_SHIFT;
+    uint8_t prevPage = (uint16_t) (addr - 1) >> PAGE_SHIFT;
+    // The previous word belongs to an instruction that overlaps the written one
+
+    if(CODE_PAGE_STATE[page] == CODE_PAGE_CACHED) CODE_PAGE_STATE[page] = CODE_PAGE_UNCACHED;
+    if(CODE_PAGE_STATE[prevPage] == CODE_PAGE_CACHED) CODE_PAGE_STATE[prevPage] = CODE_PAGE_UNCACHED;
+
+    CODE_FLUSH_PENDING = true;
+
+}
+
+static void flushCodeCaches(SmisMachine* m) {
+    // Throws away every cached block and all translated code, which also unlinks every chained exit
+    // Only the map entries of blocks in the arena can be set, so those are cleared instead of the whole maps
+
+    for(uint32_t offset = 0; offset < BLOCK_ARENA_USED; ) {
+
+        Block* block = (Block*) ((uint8_t*) BLOCK_ARENA + offset);
+
+        BLOCK_MAP[block->startAddr] = NULL;
+
+        #ifdef SMISEM_JIT
+        JIT_BLOCKS[block->startAddr] = NULL;
+        #endif
+
+        offset += BLOCK_SIZE(block->length);
+
+    }
+
+    BLOCK_ARENA_USED = 0;
+
+    #ifdef SMISEM_JIT
+    if(JIT_CODE) JIT_EMIT = JIT_BLOCKS_START;
+    #endif
+
+    for(uint32_t page = 0; page < sizeof(CODE_PAGE_STATE); page++) {
+
+        if(CODE_PAGE_STATE[page] == CODE_PAGE_CACHED) CODE_PAGE_STATE[page] = CODE_PAGE_NONE;
+
+    }
+
+    CODE_FLUSH_PENDING = false;
+
+}
+
+static void executeDecoded(SmisMachine* m, DecodedInstruction* d) {
+    // Executes a decoded instruction from the decode cache, decoding it first if it has not been yet
+
+    switch(d->opcode) {
+
+        case OP_SET: SET(m, d->rDest, d->iVal); break;
+        case OP_COPY: COPY(m, d->rDest, d->rOp1); break;
+
+        case OP_ADD: ADD(m, d->rDest, d->rOp1, d->rOp2); break;
+        case OP_SUBTRACT: SUBTRACT(m, d->rDest, d->rOp1, d->rOp2); break;
+        case OP_MULTIPLY: MULTIPLY(m, d->rDest, d->rOp1, d->rOp2); break;
+        case OP_DIVIDE: DIVIDE(m, d->rDest, d->rOp1, d->rOp2); break;
+        case OP_MODULO: MODULO(m, d->rDest, d->rOp1, d->rOp2); break;
+
+        case OP_COMPARE: COMPARE(m, d->rOp1, d->rOp2); break;
+
+        case OP_SHIFT_LEFT: SHIFT_LEFT(m, d->rDest, d->rOp1, d->rOp2); break;
+        case OP_SHIFT_RIGHT: SHIFT_RIGHT(m, d->rDest, d->rOp1, d->rOp2); break;
+
+        case OP_AND: AND(m, d->rDest, d->rOp1, d->rOp2); break;
+        case OP_OR: OR(m, d->rDest, d->rOp1, d->rOp2); break;
+        case OP_XOR: XOR(m, d->rDest, d->rOp1, d->rOp2); break;
+        case OP_NAND: NAND(m, d->rDest, d->rOp1, d->rOp2); break;
+        case OP_NOR: NOR(m, d->rDest, d->rOp1, d->rOp2); break;
+        case OP_NOT: NOT(m, d->rDest, d->rOp1); break;
+
+        case OP_ADD_IMM: ADD_IMM(m, d->rDest, d->rOp1, d->iVal); break;
+        case OP_SUBTRACT_IMM: SUBTRACT_IMM(m, d->rDest, d->rOp1, d->iVal); break;
+        case OP_MULTIPLY_IMM: MULTIPLY_IMM(m, d->rDest, d->rOp1, d->iVal); break;
+        case OP_DIVIDE_IMM: DIVIDE_IMM(m, d->rDest, d->rOp1, d->iVal); break;
+        case OP_MODULO_IMM: MODULO_IMM(m, d->rDest, d->rOp1, d->iVal); break;
+
+        case OP_COMPARE_IMM: COMPARE_IMM(m, d->rOp1, d->iVal); break;
+
+        case OP_SHIFT_LEFT_IMM: SHIFT_LEFT_IMM(m, d->rDest, d->rOp1, d->iVal); break;
+        case OP_SHIFT_RIGHT_IMM: SHIFT_RIGHT_IMM(m, d->rDest, d->rOp1, d->iVal); break;
+
+        case OP_AND_IMM: AND_IMM(m, d->rDest, d->rOp1, d->iVal); break;
+        case OP_OR_IMM: OR_IMM(m, d->rDest, d->rOp1, d->iVal); break;
+        case OP_XOR_IMM: XOR_IMM(m, d->rDest, d->rOp1, d->iVal); break;
+        case OP_NAND_IMM: NAND_IMM(m, d->rDest, d->rOp1, d->iVal); break;
+        case OP_NOR_IMM: NOR_IMM(m, d->rDest, d->rOp1, d->iVal); break;
+
+        case OP_LOAD: LOAD(m, d->rDest, d->rOp1, d->iVal); break;
+        case OP_STORE: STORE(m, d->rDest, d->rOp1, d->iVal); break;
+
+        case OP_JUMP: JUMP(m, d->iVal); break;
+        case OP_JUMP_IF_ZERO: JUMP_IF_ZERO(m, d->iVal); break;
+        case OP_JUMP_IF_NOTZERO: JUMP_IF_NOTZERO(m, d->iVal); break;
+        case OP_JUMP_LINK: JUMP_LINK(m, d->iVal); break;
+
+        case OP_HALT: HALT(m); break;
+
+        case OP_UNDECODED:
+            decodeInstruction(m, d - DECODE_CACHE);
+            executeDecoded(m, d);
+            break;
+
+        default: unknownInstruction(m);
+
+    }
+
+}
+
+static void unknownInstruction(SmisMachine* m) {
+    // Stops the machine at the invalid instruction that was just fetched
+
+    PC -= 2;
+    grabNextInstruction(m);
+
+    m->status = SMIS_STATUS_UNKNOWN_INSTRUCTION;
+
+}
+
+static void divideByZero(SmisMachine* m) {
+    // Stops the machine at the divide instruction that was just fetched, instead of letting the host trap
+
+    PC -= 2;
+
+    m->status = SMIS_STATUS_DIVIDE_BY_ZERO;
+
+}
+
+static void decodeInstruction(SmisMachine* m, uint16_t addr) {
+    // Decodes the instruction at a given address and stores it in the decode cache
+
+    uint32_t instruction = (uint32_t) MEM[addr] << 16 | MEM[(uint16_t) (addr + 1)];
+
+    DecodedInstruction* d = &DECODE_CACHE[addr];
+
+    touchPage(m, addr);
+
+    d->opcode = getOpcode(instruction);
+    d->rDest = getRegOperand(instruction, 1);
+    d->rOp1 = getRegOperand(instruction, 2);
+    d->rOp2 = getRegOperand(instruction, 3);
+    d->iVal = getDestOrImmVal(instruction);
+
+    if(instruction == 0x00000000) d->opcode = OP_HALT;
+    // An empty word ends the program, in the same way as running into the appended HALT
+    else if(d->opcode < OP_SET || d->opcode > OP_HALT) d->opcode = OP_INVALID;
+
+}
+
+static void grabNextInstruction(SmisMachine* m) {
+    // Gets the next instruction from memory and places it in the instruction register
+
+    IR = 0;
+
+    IR ^= (uint32_t) MEM[PC] << 16;
+    IR ^= MEM[(uint16_t) (PC + 1)];
+
+}
+
+static void traceInstruction(SmisMachine* m, uint16_t instructionAddr) {
+    // Writes the trace line for the instruction that was just executed
+
+    uint8_t opcode = IR ? getOpcode(IR) : OP_HALT;
+    const char* mnemonic = smisMnemonic(opcode) ? smisMnemonic(opcode) : "(unknown)";
+    // An all-zero word runs as HALT, the same as in decodeInstruction() and smistrace
+
+    if(m->traceLevel == SMIS_TRACE_BINARY) {
+
+        traceBinary(m, instructionAddr);
+        return;
+
+    }
+
+    if(m->traceLevel == SMIS_TRACE_MNEMONICS) {
+
+        fprintf(m->traceStream, "%s\n", mnemonic);
+        return;
+
+    }
+
+    fprintf(m->traceStream, "0x%.4X  0x%.8X  %-16s", instructionAddr, IR, mnemonic);
+
+    if(writesRegDest(opcode)) fprintf(m->traceStream, "R%i = %i  ", getRegOperand(IR, 1), REG[getRegOperand(IR, 1)]);
+    else if(opcode == OP_JUMP_LINK) fprintf(m->traceStream, "RLR = %i  ", RLR);
+
+    fprintf(m->traceStream, "ZF = %i  SF = %i\n", ZF, SF);
+
+}
+
+static void traceBinary(SmisMachine* m, uint16_t instructionAddr) {
+    // Appends the binary trace record for the instruction that was just executed, see libsmisem.h for the format
+
+    uint8_t* record = &m->traceChunk[m->traceChunkUsed];
+    uint8_t opcode = getOpcode(IR);
+    uint8_t header = (ZF ? 0x08 : 0x00) | (SF ? 0x10 : 0x00);
+    int size = 1;
+
+    if(instructionAddr != m->traceNextPC) {
+
+        header |= 0x01;
+        size += putTraceBytes(record + size, instructionAddr, 2);
+
+    }
+
+    size += putTraceBytes(record + size, IR, 4);
+
+    if(writesRegDest(opcode) || opcode == OP_JUMP_LINK) {
+
+        uint8_t reg = opcode == OP_JUMP_LINK ? 0xD : getRegOperand(IR, 1);
+
+        header |= 0x02;
+        size += putTraceBytes(record + size, reg, 1);
+        size += putTraceBytes(record + size, REG[reg], 2);
+
+    }
+
+    if(opcode == OP_STORE) {
+
+        uint16_t addr = REG[getRegOperand(IR, 2)] + getDestOrImmVal(IR);
+
+        header |= 0x04;
+        size += putTraceBytes(record + size, addr, 2);
+        size += putTraceBytes(record + size, MEM[addr], 2);
+
+    }
+
+    record[0] = header;
+
+    m->traceChunkUsed += size;
+    m->traceNextPC = instructionAddr + 2;
+
+    if(m->traceChunkUsed + TRACE_RECORD_MAX > SMIS_TRACE_CHUNK_SIZE) flushTrace(m);
+
+}
+
+static void startTraceChunk(SmisMachine* m) {
+    // Begins a binary trace chunk with the instruction at PC, which is always given its PC in full
+
+    uint64_t step = m->steps + (uint16_t) (PC - m->segmentStart) / 2;
+
+    memcpy(m->traceChunk, "SMTC", 4);
+    putTraceBytes(m->traceChunk + 8, step, 4);
+    putTraceBytes(m->traceChunk + 12, step >> 32, 4);
+
+    m->traceChunkUsed = TRACE_CHUNK_HEADER;
+    m->traceNextPC = PC + 1;
+
+}
+
+static void flushTrace(SmisMachine* m) {
+    // Hands the current binary trace chunk to the sink (or writes it to the trace stream) if it holds any records
+
+    if(m->traceChunkUsed <= TRACE_CHUNK_HEADER) {
+
+        m->traceChunkUsed = 0;
+        return;
+
+    }
+
+    putTraceBytes(m->traceChunk + 4, m->traceChunkUsed - TRACE_CHUNK_HEADER, 4);
+
+    if(m->traceSink) m->traceSink(m->traceContext, m->traceChunk, m->traceChunkUsed);
+    else fwrite(m->traceChunk, 1, m->traceChunkUsed, m->traceStream);
+
+    m->traceChunkUsed = 0;
+
+}
+
+static int putTraceBytes(uint8_t* dest, uint32_t value, int count) {
+    // Writes the low count bytes of a value in little-endian order, returning the number of bytes written
+
+    for(int i = 0; i < count; i++) dest[i] = value >> (8 * i);
+
+    return count;
+
+}
+
+static void touchPage(SmisMachine* m, uint16_t addr) {
+    // Records that the page holding a given address has to be cleared by the next reset
+
+    uint8_t page = addr >> PAGE_SHIFT;
+
+    if(m->touchedPages[page]) return;
+
+    m->touchedPages[page] = true;
+    m->touchedPageList[m->touchedPageCount++] = page;
+
+}
+
+static void copyPage(SmisMachine* m, SmisMachine* source, uint8_t page) {
+    // Copies a page of memory, along with its decode cache entries, from another machine
+
+    uint16_t start = page << PAGE_SHIFT;
+
+    memcpy(&MEM[start], &source->memory[start], PAGE_WORDS * sizeof(MEM[0]));
+    memcpy(&DECODE_CACHE[start], &source->decodeCache[start], PAGE_WORDS * sizeof(DECODE_CACHE[0]));
+
+}
+
+static void clearDirtyPages(SmisMachine* m) {
+    // Forgets which pages have been written to
+
+    for(int page = 0; page < m->dirtyPageCount; page++) m->dirtyPages[m->dirtyPageList[page]] = false;
+
+    m->dirtyPageCount = 0;
+
+}
+
+static void takeJump(SmisMachine* m, uint16_t destAddr) {
+    // Moves PC to the destination of a jump (taken or not), counting the straight line of code that the jump ends
+    // This is the only place budgets are checked, which keeps them off every other instruction
+
+    m->steps += (uint16_t) (PC - m->segmentStart) / 2;
+
+    if(m->profile) profileJump(m, destAddr);
+
+    PC = destAddr;
+    m->segmentStart = destAddr;
+
+    if(m->steps >= m->nextBudgetCheck) checkBudget(m);
+
+}
+
+static void checkBudget(SmisMachine* m) {
+    // Stops the machine if the current run has used up its step or time budget or reached the breakpoint,
+    // otherwise sets the next check point
+
+    if(HALTED) return;
+    // The JIT also comes here after a HALT, which must not be turned into a budget stop
+
+    if(m->steps >= m->stepLimit || (m->deadline && getTimeNs() >= m->deadline)) {
+
+        m->status = SMIS_STATUS_BUDGET_EXHAUSTED;
+        return;
+
+    }
+
+    if(m->breakpointSet && PC == m->breakpoint) {
+
+        m->status = SMIS_STATUS_BREAKPOINT;
+        return;
+
+    }
+
+    setNextBudgetCheck(m);
+
+}
+
+static void setNextBudgetCheck(SmisMachine* m) {
+    // Sets the step count at which jumps next have to call checkBudget()
+
+    m->nextBudgetCheck = m->stepLimit;
+
+    if(m->deadline && m->nextBudgetCheck > m->steps + BUDGET_CLOCK_INTERVAL) m->nextBudgetCheck = m->steps + BUDGET_CLOCK_INTERVAL;
+
+    if(m->breakpointSet) m->nextBudgetCheck = 0;
+
+}
+
+static void profileSegment(SmisMachine* m, uint16_t endAddr) {
+    // Counts one run through the straight line of code from segmentStart up to (not including) endAddr
+
+    m->profile->segments[m->segmentStart]++;
+    m->profile->segments[endAddr]--;
+
+    if(endAddr <= m->segmentStart) m->profile->segments[0x10000 + (endAddr & 1)]++;
+
+}
+
+static void profileJump(SmisMachine* m, uint16_t destAddr) {
+    // Counts the straight line of code ending with the jump at PC - 2, and whether the jump went anywhere but the next
+    // instruction (only used for conditional jumps, whose fall-through count is worked out from their executions)
+
+    profileSegment(m, PC);
+
+    if(destAddr != PC) m->profile->taken[(uint16_t) (PC - 2)]++;
+
+}
+
+static uint64_t getTimeNs() {
+    // Returns the monotonic clock in nanoseconds
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+
+}
+
+static void setFlags(SmisMachine* m, uint16_t result) {
+    // Sets flags according to the given value, usually the result of an arithmetic operation
+    // Only the value is recorded, ZF and SF are worked out from it when they are read
+
+    FLAG_RESULT = result;
+
+}
+
+static void SET(SmisMachine* m, uint8_t rDest, uint16_t iVal) {
+    // Executes a SET instruction
+
+    REG[rDest] = iVal;
+
+}
+
+static void COPY(SmisMachine* m, uint8_t rDest, uint8_t rSrc) {
+    // Executes a COPY instruction
+
+    REG[rDest] = REG[rSrc];
+
+}
+
+static void ADD(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
+    // Executes an ADD instruction
+
+    REG[rDest] = REG[rOp1] + REG[rOp2];
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void SUBTRACT(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
+    // Executes a SUBTRACT instruction
+
+    REG[rDest] = REG[rOp1] - REG[rOp2];
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void MULTIPLY(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
+    // Executes a MULTIPLY instruction
+
+    REG[rDest] = REG[rOp1] * REG[rOp2];
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void DIVIDE(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
+    // Executes a DIVIDE instruction
+
+    if(!REG[rOp2]) {
+
+        divideByZero(m);
+        return;
+
+    }
+
+    REG[rDest] = REG[rOp1] / REG[rOp2];
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void MODULO(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
+    // Executes a MODULO instruction
+
+    if(!REG[rOp2]) {
+
+        divideByZero(m);
+        return;
+
+    }
+
+    REG[rDest] = REG[rOp1] % REG[rOp2];
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void COMPARE(SmisMachine* m, uint8_t rOp1, uint8_t rOp2) {
+    // Executes a COMPARE instruction
+
+    uint16_t throwawayVal = REG[rOp1] + REG[rOp2];
+
+    setFlags(m, throwawayVal);
+
+}
+
+static void SHIFT_LEFT(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
+    // Executes a SHIFT-LEFT instruction
+
+    REG[rDest] = REG[rOp1] << REG[rOp2];
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void SHIFT_RIGHT(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
+    // Executes a SHIFT-RIGHT instruction
+
+    REG[rDest] = REG[rOp1] >> REG[rOp2];
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void AND(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
+    // Executes an AND instruction
+
+    REG[rDest] = REG[rOp1] & REG[rOp2];
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void OR(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
+    // Executes an OR instruction
+
+    REG[rDest] = REG[rOp1] | REG[rOp2];
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void XOR(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
+    // Executes an XOR instruction
+
+    REG[rDest] = REG[rOp1] ^ REG[rOp2];
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void NAND(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
+    // Executes a NAND instruction
+
+    REG[rDest] = ~(REG[rOp1] & REG[rOp2]);
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void NOR(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
+    // Executes a NOR instruction
+
+    REG[rDest] = ~(REG[rOp1] | REG[rOp2]);
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void NOT(SmisMachine* m, uint8_t rDest, uint8_t rOp) {
+    // Executes a NOT instruction
+
+    REG[rDest] = ~REG[rOp];
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void ADD_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
+    // Executes an ADD-IMM instruction
+
+    REG[rDest] = REG[rOp1] + iOp2;
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void SUBTRACT_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
+    // Executes a SUBTRACT-IMM instruction
+
+    REG[rDest] = REG[rOp1] - iOp2;
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void MULTIPLY_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
+    // Executes a MULTIPLY-IMM instruction
+
+    REG[rDest] = REG[rOp1] * iOp2;
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void DIVIDE_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
+    // Executes a DIVIDE-IMM instruction
+
+    if(!iOp2) {
+
+        divideByZero(m);
+        return;
+
+    }
+
+    REG[rDest] = REG[rOp1] / iOp2;
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void MODULO_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
+    // Executes a MODULO-IMM instruction
+
+    if(!iOp2) {
+
+        divideByZero(m);
+        return;
+
+    }
+
+    REG[rDest] = REG[rOp1] % iOp2;
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void COMPARE_IMM(SmisMachine* m, uint8_t rOp1, uint16_t iOp2) {
+    // Executes a COMPARE-IMM instruction
+
+    uint16_t throwawayVal = REG[rOp1] - iOp2;
+
+    setFlags(m, throwawayVal);
+
+}
+
+static void SHIFT_LEFT_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
+    // Executes a SHIFT-LEFT-IMM instruction
+
+    REG[rDest] = REG[rOp1] << iOp2;
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void SHIFT_RIGHT_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
+    // Executes a SHIFT-RIGHT-IMM instruction
+
+    REG[rDest] = REG[rOp1] >> iOp2;
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void AND_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
+    // Executes an AND-IMM instruction
+
+    REG[rDest] = REG[rOp1] & iOp2;
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void OR_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
+    // Executes an OR-IMM instruction
+
+    REG[rDest] = REG[rOp1] | iOp2;
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void XOR_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
+    // Executes an XOR-IMM instruction
+
+    REG[rDest] = REG[rOp1] ^ iOp2;
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void NAND_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
+    // Executes a NAND-IMM instruction
+
+    REG[rDest] = ~(REG[rOp1] & iOp2);
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void NOR_IMM(SmisMachine* m, uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
+    // Executes A NOR-IMM instruction
+
+    REG[rDest] = ~(REG[rOp1] | iOp2);
+
+    setFlags(m, REG[rDest]);
+
+}
+
+static void LOAD(SmisMachine* m, uint8_t rDest, uint8_t rBase, uint16_t iOffset) {
+    // Executes a LOAD instruction
+
+    REG[rDest] = MEM[(uint16_t) (REG[rBase] + iOffset)];
+
+}
+
+static void STORE(SmisMachine* m, uint8_t rSrc, uint8_t rBase, uint16_t iOffset) {
+    // Executes a STORE instruction
+
+    writeMemory(m, REG[rBase] + iOffset, REG[rSrc]);
+
+}
+
+static void JUMP(SmisMachine* m, uint16_t destAddr) {
+    // Executes a JUMP instruction
+
+    takeJump(m, destAddr);
+
+}
+
+static void JUMP_IF_ZERO(SmisMachine* m, uint16_t destAddr) {
+    // Executes a JUMP-IF-ZERO instruction
+
+    takeJump(m, ZF ? destAddr : PC);
+
+}
+
+static void JUMP_IF_NOTZERO(SmisMachine* m, uint16_t destAddr) {
+    // Executes a JUMP-IF-NOTZERO instruction
+
+    takeJump(m, !ZF ? destAddr : PC);
+
+}
+
+static void JUMP_LINK(SmisMachine* m, uint16_t destAddr) {
+    // Executes a JUMP-LINK instruction
+
+    RLR = PC;
+    takeJump(m, destAddr);
+
+}
+
+static void HALT(SmisMachine* m) {
+    // Executes a HALT instruction
+
+    m->status = SMIS_STATUS_HALTED;
+
+}
+
+static void writeMemory(SmisMachine* m, uint16_t addr, uint16_t value) {
+    // Writes a word of memory on behalf of STORE
+
+    MEM[addr] = value;
+
+    touchPage(m, addr);
+
+    if(!m->dirtyPages[addr >> PAGE_SHIFT]) {
+
+        m->dirtyPages[addr >> PAGE_SHIFT] = true;
+        m->dirtyPageList[m->dirtyPageCount++] = addr >> PAGE_SHIFT;
+
+    }
+
+    DECODE_CACHE[addr].opcode = OP_UNDECODED;
+    DECODE_CACHE[(uint16_t) (addr - 1)].opcode = OP_UNDECODED;
+    // Both instructions that overlap the written word have to be decoded again if they are executed
+
+    if(CODE_PAGE_STATE[addr >> PAGE_SHIFT] == CODE_PAGE_CACHED
+        || CODE_PAGE_STATE[(uint16_t) (addr - 1) >> PAGE_SHIFT] == CODE_PAGE_CACHED) noteCodeWrite(m, addr);
+
+}
+
+static uint8_t getOpcode(uint32_t instruction) {
+    // Gets the opcode of a given instruction
+
+    return instruction >> 24;
+
+}
+
+static uint8_t getRegOperand(uint32_t instruction, uint8_t opNum) {
+    // Gets the first operand of a given instruction
+
+    opNum--;
+
+    if(opNum > 2) {
+
+        printf("Internal error: cannot retrieve register operand %i of instruction 0x%.8X\n", opNum + 1, instruction);
+        exit(-2);
+
+    }
+
+    return (instruction & (0x00F00000 >> (4 * opNum))) >> (20 - (4 * opNum));
+    // TODO: There is probably a much nicer way to do this, but it works
+
+}
+
+static uint16_t getDestOrImmVal(uint32_t instruction) {
+    // Gets the destination address of a J-Type instruction or immediate value of an I-Type instruction
+
+    return instruction & 0xFFFF;
+
+}
+
+static bool writesRegDest(uint8_t opcode) {
+    // Returns true if a given opcode writes its result to the destination register operand
+
+    if(opcode == OP_COMPARE || opcode == OP_COMPARE_IMM || opcode == OP_STORE) return false;
+
+    return opcode >= OP_SET && opcode <= OP_LOAD;
+
+}
@@ -0,0 +1,113 @@
+#ifndef LIBSMISEM_H
+#define LIBSMISEM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+#define SMIS_STATUS_RUNNING             0
+#define SMIS_STATUS_HALTED              1
+#define SMIS_STATUS_UNKNOWN_INSTRUCTION 2
+#define SMIS_STATUS_DIVIDE_BY_ZERO      3
+#define SMIS_STATUS_BUDGET_EXHAUSTED    4
+#define SMIS_STATUS_BREAKPOINT          5
+// A stopped machine leaves PC at the instruction that stopped it, except after HALT where PC is past the HALT
+// A machine that used up its budget or jumped to its breakpoint is stopped at the destination of a jump and carries on
+// from there when run again
+
+#define SMIS_ENGINE_SWITCH              0
+#define SMIS_ENGINE_THREADED            1
+#define SMIS_ENGINE_JIT                 2
+#define SMIS_ENGINE_BLOCKS              3
+
+#define SMIS_TRACE_NONE                 0
+#define SMIS_TRACE_MNEMONICS            1
+#define SMIS_TRACE_STATE                2
+#define SMIS_TRACE_BINARY               3
+// Trace levels: nothing, one mnemonic per instruction, PC/IR/result/flags per instruction, or compact binary records
+
+#define SMIS_TRACE_CHUNK_SIZE           0x10000
+// Binary traces are a sequence of chunks of at most this many bytes, each of which can be decoded on its own:
+//     "SMTC", uint32 size of the records that follow, uint64 number of instructions executed before the first record
+// followed by one record per executed instruction (all numbers little-endian):
+//     uint8 header, bit 0 = PC follows (it is left out when it is 2 past the previous record's), bit 1 = register
+//         write follows, bit 2 = memory write follows, bit 3 = ZF, bit 4 = SF afterwards
+//     [uint16 PC], uint32 instruction, [uint8 register, uint16 value], [uint16 address, uint16 value]
+// Instructions that failed (unknown instructions and divides by zero) are not recorded
+
+#define SMIS_SNAPSHOT_VERSION           1
+// Snapshot files hold the machine state in the byte order of the machine that wrote them, so they can be mapped
+// and copied straight into memory:
+//     "SMSN", uint16 version, uint16 page count, uint16 registers[16], uint16 PC, uint16 flag result, uint8 status,
+//     uint8 page numbers[256], padding to 8 bytes, uint64 instructions executed
+// followed by the 256 words of each listed page, only pages that are in use and not all zero are stored
+
+
+typedef struct SmisMachine SmisMachine;
+// One emulated SMIS machine, machines share nothing and can each be used from a different thread
+// The exception is smisFork(), which reads the parent machine, so any number of threads can fork from one parent
+// at once as long as nothing runs or changes the parent meanwhile
+
+typedef void (*SmisTraceSink)(void* context, const uint8_t* chunk, size_t size);
+// Receives each finished chunk of a binary trace, the chunk is only valid until the sink returns
+
+typedef struct SmisProfile {
+
+    uint64_t executions[0x10000];
+    // Times the instruction at each address was executed
+    uint64_t taken[0x10000];
+    uint64_t notTaken[0x10000];
+    // Times each JUMP-IF-ZERO or JUMP-IF-NOTZERO jumped or fell through, both are 0 for every other instruction
+    uint64_t opcodes[0x100];
+    // Executions per opcode, attributed by the instruction each address holds when the profile is read
+
+} SmisProfile;
+// Execution counts collected since the program was loaded
+
+
+SmisMachine* smisCreate();
+void smisDestroy(SmisMachine* m);
+void smisReset(SmisMachine* m);
+// Machine lifetime functions
+
+bool smisLoad(SmisMachine* m, const uint8_t* image, size_t size);
+bool smisLoadFile(SmisMachine* m, const char* binfile);
+// Program loading functions
+
+bool smisEngineAvailable(uint8_t engine);
+bool smisSetEngine(SmisMachine* m, uint8_t engine);
+void smisSetTrace(SmisMachine* m, uint8_t level, FILE* stream);
+void smisSetTraceSink(SmisMachine* m, SmisTraceSink sink, void* context);
+void smisSetBudget(SmisMachine* m, uint64_t maxSteps, uint64_t maxMilliseconds);
+void smisSetBreakpoint(SmisMachine* m, bool enabled, uint16_t addr);
+uint8_t smisRun(SmisMachine* m, uint64_t maxSteps);
+uint8_t smisRunToStep(SmisMachine* m, uint64_t step);
+uint8_t smisGetStatus(SmisMachine* m);
+uint64_t smisGetSteps(SmisMachine* m);
+// Execution functions
+
+bool smisSetProfiling(SmisMachine* m, bool enabled);
+bool smisGetProfile(SmisMachine* m, SmisProfile* profile);
+const char* smisMnemonic(uint8_t opcode);
+// Profiling functions
+
+bool smisSaveSnapshot(SmisMachine* m, const char* file);
+bool smisLoadSnapshot(SmisMachine* m, const char* file);
+void smisFork(SmisMachine* m, SmisMachine* parent);
+// Snapshot functions
+
+uint16_t smisGetRegister(SmisMachine* m, uint8_t reg);
+void smisSetRegister(SmisMachine* m, uint8_t reg, uint16_t value);
+uint16_t smisGetPC(SmisMachine* m);
+void smisSetPC(SmisMachine* m, uint16_t addr);
+bool smisGetZeroFlag(SmisMachine* m);
+bool smisGetSignFlag(SmisMachine* m);
+uint16_t smisReadMemory(SmisMachine* m, uint16_t addr);
+uint8_t smisGetOpcode(SmisMachine* m, uint16_t addr);
+void smisWriteMemory(SmisMachine* m, uint16_t addr, uint16_t value);
+uint32_t smisMemoryChecksum(SmisMachine* m);
+// Machine state functions
+
+#endif
@@ -0,0 +1,403 @@
+/*
+
+SMIS emulator benchmark
+
+Measures how fast each emulator engine runs a set of SMIS programs, reporting instructions executed, run time,
+MIPS (millions of instructions per second) and nanoseconds per instruction for every program and engine.
+With --opcodes it also measures the cost of each individual opcode on every engine.
+
+Program overview:
+
+    Each program is loaded and run to completion once per repetition on every engine that is part of the build, and
+    the fastest of the repetitions is reported so that one-off disturbances (page faults, other processes) drop out.
+    Loading is not timed, only the run itself.
+
+    Opcode costs are measured with generated programs: a loop whose body is OPCODE_BODY_LEN copies of a single
+    instruction, and an otherwise identical loop with an empty body. The difference in run time divided by the number
+    of copies executed is the cost of the opcode alone, without the loop around it.
+
+    Results are printed as a table, or with --csv as comma-separated lines with a header line so that runs of
+    different releases can be compared by scripts. Every line has the same columns:
+        type (program or opcode), name, engine, instructions, seconds, MIPS, ns per instruction
+    For opcodes, instructions counts only the measured copies and seconds is their share of the run time.
+
+    The programs in Emulator/Benchmarks cover tight ALU loops, LOAD/STORE array walks, JUMP-LINK calls and DIVIDE/MODULO
+    heavy code. They are assembled like any other program, e.g. "../Assembler/smisasm Benchmarks/alu.txt Benchmarks/alu.bin".
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "libsmisem.h"
+
+
+#define USAGE "Usage: ./smisbench [--engine=switch|threaded|blocks|jit] [--repeat=<n>] [--opcodes] [--csv] [<executable .bin files>]\n"
+#define MAX_STRING_LEN 500
+
+#define DEFAULT_REPEAT 5
+
+#define OPCODE_BODY_LEN 64
+#define OPCODE_LOOP_ITERATIONS 60000
+#define OPCODE_LOOP_ADDR 8
+// The generated programs set up R1 (loop counter), R4, R5 and R6 in the 4 instructions before the loop
+
+#define OP_SET              1
+#define OP_COPY             2
+
+#define OP_ADD              3
+#define OP_SUBTRACT         4
+#define OP_MULTIPLY         5
+#define OP_DIVIDE           6
+#define OP_MODULO           7
+
+#define OP_COMPARE          8
+
+#define OP_SHIFT_LEFT       9
+#define OP_SHIFT_RIGHT      10
+
+#define OP_AND              11
+#define OP_OR               12
+#define OP_XOR              13
+#define OP_NAND             14
+#define OP_NOR              15
+#define OP_NOT              16
+
+#define OP_ADD_IMM          17
+#define OP_SUBTRACT_IMM     18
+#define OP_MULTIPLY_IMM     19
+#define OP_DIVIDE_IMM       20
+#define OP_MODULO_IMM       21
+
+#define OP_COMPARE_IMM      22
+#define OP_SHIFT_LEFT_IMM   23
+#define OP_SHIFT_RIGHT_IMM  24
+#define OP_AND_IMM          25
+#define OP_OR_IMM           26
+#define OP_XOR_IMM          27
+#define OP_NAND_IMM         28
+#define OP_NOR_IMM          29
+
+#define OP_LOAD             30
+#define OP_STORE            31
+
+#define OP_JUMP             32
+#define OP_JUMP_IF_ZERO     33
+#define OP_JUMP_IF_NOTZERO  34
+#define OP_JUMP_LINK        35
+
+#define OP_HALT             36
+
+
+const uint32_t OPCODE_OPERANDS[] = {
+
+    [OP_SET] = 0x300007, [OP_COPY] = 0x340000,
+    [OP_ADD] = 0x345000, [OP_SUBTRACT] = 0x345000, [OP_MULTIPLY] = 0x345000,
+    [OP_DIVIDE] = 0x345000, [OP_MODULO] = 0x345000,
+    [OP_COMPARE] = 0x045000,
+    [OP_SHIFT_LEFT] = 0x345000, [OP_SHIFT_RIGHT] = 0x345000,
+    [OP_AND] = 0x345000, [OP_OR] = 0x345000, [OP_XOR] = 0x345000,
+    [OP_NAND] = 0x345000, [OP_NOR] = 0x345000, [OP_NOT] = 0x340000,
+    [OP_ADD_IMM] = 0x340007, [OP_SUBTRACT_IMM] = 0x340007, [OP_MULTIPLY_IMM] = 0x340007,
+    [OP_DIVIDE_IMM] = 0x340007, [OP_MODULO_IMM] = 0x340007,
+    [OP_COMPARE_IMM] = 0x040007,
+    [OP_SHIFT_LEFT_IMM] = 0x340007, [OP_SHIFT_RIGHT_IMM] = 0x340007,
+    [OP_AND_IMM] = 0x340007, [OP_OR_IMM] = 0x340007, [OP_XOR_IMM] = 0x340007,
+    [OP_NAND_IMM] = 0x340007, [OP_NOR_IMM] = 0x340007,
+    [OP_LOAD] = 0x360000, [OP_STORE] = 0x460000,
+    [OP_JUMP] = 0, [OP_JUMP_IF_ZERO] = 0,
+    [OP_JUMP_IF_NOTZERO] = 0, [OP_JUMP_LINK] = 0
+
+};
+// Operand fields of the measured instruction for each opcode, writing to R3 from R4 (1234), R5 (7) or the address in R6
+// Jumps get the address of the instruction after them, so every copy is executed
+
+const char* ENGINE_NAMES[] = {
+
+    [SMIS_ENGINE_SWITCH] = "switch",
+    [SMIS_ENGINE_THREADED] = "threaded",
+    [SMIS_ENGINE_JIT] = "jit",
+    [SMIS_ENGINE_BLOCKS] = "blocks"
+
+};
+// Engine names as given to --engine, indexed by engine number
+
+
+int ENGINE = -1;
+// The engine given on the command line, every engine in the build is measured otherwise
+
+int REPEAT = DEFAULT_REPEAT;
+bool OPCODES = false;
+bool CSV = false;
+
+
+void benchmarkProgram(SmisMachine* m, uint8_t engine, char* binfile);
+void benchmarkOpcodes(SmisMachine* m, uint8_t engine);
+double timeRun(SmisMachine* m, const uint8_t* image, size_t size, char* binfile, uint64_t* steps);
+// Benchmark functions
+
+size_t buildOpcodeProgram(uint8_t* image, uint8_t opcode);
+size_t putInstruction(uint8_t* image, size_t size, uint32_t instruction);
+void printHeader();
+void printResult(char* type, const char* name, uint8_t engine, uint64_t instructions, double seconds);
+// Benchmark utility functions
+
+bool containsOnlyNums(char* str);
+bool endsWith(char* str, char* substr);
+// General utility functions
+
+
+int main(int argc, char** argv) {
+
+    char** binfiles = malloc(argc * sizeof(char*));
+    int binfileCount = 0;
+
+    for(int arg = 1; arg < argc; arg++) {
+
+        if(!strncmp(argv[arg], "--engine=", 9)) {
+
+            for(uint8_t engine = 0; engine < sizeof(ENGINE_NAMES) / sizeof(ENGINE_NAMES[0]); engine++) {
+
+                if(!strncmp(argv[arg] + 9, ENGINE_NAMES[engine], MAX_STRING_LEN)) ENGINE = engine;
+
+            }
+
+            if(ENGINE < 0) {
+
+                printf("Unknown engine %s.\n", argv[arg] + 9);
+                printf(USAGE);
+                exit(-1);
+
+            }
+
+            if(!smisEngineAvailable(ENGINE)) {
+
+                printf("This build of smisbench does not include the %s engine.\n", ENGINE_NAMES[ENGINE]);
+                exit(-1);
+
+            }
+
+        } else if(!strncmp(argv[arg], "--repeat=", 9) && containsOnlyNums(argv[arg] + 9) && argv[arg][9]
+            && strtol(argv[arg] + 9, NULL, 10) > 0) {
+
+            REPEAT = strtol(argv[arg] + 9, NULL, 10);
+
+        } else if(!strncmp(argv[arg], "--opcodes", MAX_STRING_LEN)) OPCODES = true;
+        else if(!strncmp(argv[arg], "--csv", MAX_STRING_LEN)) CSV = true;
+        else if(endsWith(argv[arg], ".bin")) binfiles[binfileCount++] = argv[arg];
+        else {
+
+            printf("Unknown argument %s.\n", argv[arg]);
+            printf(USAGE);
+            exit(-1);
+
+        }
+
+    }
+
+    if(!binfileCount && !OPCODES) {
+
+        printf("Nothing to measure, supply .bin files or --opcodes.\n");
+        printf(USAGE);
+        exit(-1);
+
+    }
+
+    SmisMachine* m = smisCreate();
+
+    if(!m) {
+
+        printf("Could not allocate memory for the machine.\n");
+        exit(-1);
+
+    }
+
+    smisSetTrace(m, SMIS_TRACE_NONE, stdout);
+
+    printHeader();
+
+    for(uint8_t engine = 0; engine < sizeof(ENGINE_NAMES) / sizeof(ENGINE_NAMES[0]); engine++) {
+
+        if((ENGINE >= 0 && engine != ENGINE) || !smisEngineAvailable(engine)) continue;
+
+        smisSetEngine(m, engine);
+
+        for(int i = 0; i < binfileCount; i++) benchmarkProgram(m, engine, binfiles[i]);
+
+        if(OPCODES) benchmarkOpcodes(m, engine);
+
+    }
+
+    smisDestroy(m);
+    free(binfiles);
+
+}
+
+void benchmarkProgram(SmisMachine* m, uint8_t engine, char* binfile) {
+    // Runs a program from a .bin file on one engine and prints its best time
+
+    uint64_t steps;
+    double seconds = timeRun(m, NULL, 0, binfile, &steps);
+
+    printResult("program", binfile, engine, steps, seconds);
+
+}
+
+void benchmarkOpcodes(SmisMachine* m, uint8_t engine) {
+    // Measures the cost of every opcode on one engine, as the difference between a loop of that opcode and an empty loop
+
+    uint8_t image[(OPCODE_LOOP_ADDR / 2 + OPCODE_BODY_LEN + 3) * 4];
+    uint64_t steps;
+
+    size_t size = buildOpcodeProgram(image, 0);
+    double baseline = timeRun(m, image, size, NULL, &steps);
+
+    for(uint8_t opcode = OP_SET; opcode < OP_HALT; opcode++) {
+
+        size = buildOpcodeProgram(image, opcode);
+        double seconds = timeRun(m, image, size, NULL, &steps) - baseline;
+
+        if(seconds < 0) seconds = 0;
+        // Cheap opcodes can come out slightly faster than the empty loop because of timing noise
+
+        printResult("opcode", smisMnemonic(opcode), engine, (uint64_t) OPCODE_LOOP_ITERATIONS * OPCODE_BODY_LEN, seconds);
+
+    }
+
+}
+
+double timeRun(SmisMachine* m, const uint8_t* image, size_t size, char* binfile, uint64_t* steps) {
+    // Loads and runs a program REPEAT times, either from a .bin file or from an image in memory
+    // Returns the shortest run time in seconds, terminating the program if it does not halt properly
+
+    double best = -1;
+
+    for(int i = 0; i < REPEAT; i++) {
+
+        if(!(binfile ? smisLoadFile(m, binfile) : smisLoad(m, image, size))) {
+
+            printf("File %s does not exist or is too large.\n", binfile ? binfile : "(generated)");
+            exit(-1);
+
+        }
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        uint8_t status = smisRun(m, 0);
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if(status != SMIS_STATUS_HALTED) {
+
+            printf("Program %s stopped at PC address 0x%.4X without halting.\n", binfile ? binfile : "for the opcode benchmark", smisGetPC(m));
+            exit(-1);
+
+        }
+
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+        if(best < 0 || seconds < best) best = seconds;
+
+    }
+
+    *steps = smisGetSteps(m);
+
+    return best;
+
+}
+
+size_t buildOpcodeProgram(uint8_t* image, uint8_t opcode) {
+    // Writes a program that runs OPCODE_BODY_LEN copies of an opcode OPCODE_LOOP_ITERATIONS times into an image
+    // An opcode of 0 gives the same loop with an empty body, returns the size of the image in bytes
+
+    size_t size = 0;
+
+    size = putInstruction(image, size, OP_SET << 24 | 0x100000 | OPCODE_LOOP_ITERATIONS);
+    size = putInstruction(image, size, OP_SET << 24 | 0x400000 | 1234);
+    size = putInstruction(image, size, OP_SET << 24 | 0x500000 | 7);
+    size = putInstruction(image, size, OP_SET << 24 | 0x600000 | 0x8000);
+
+    for(int i = 0; opcode && i < OPCODE_BODY_LEN; i++) {
+
+        uint32_t operands = OPCODE_OPERANDS[opcode];
+
+        if(opcode >= OP_JUMP) operands = OPCODE_LOOP_ADDR + (i + 1) * 2;
+
+        size = putInstruction(image, size, opcode << 24 | operands);
+
+    }
+
+    size = putInstruction(image, size, OP_SUBTRACT_IMM << 24 | 0x110001);
+    size = putInstruction(image, size, OP_JUMP_IF_NOTZERO << 24 | OPCODE_LOOP_ADDR);
+    size = putInstruction(image, size, OP_HALT << 24);
+
+    return size;
+
+}
+
+size_t putInstruction(uint8_t* image, size_t size, uint32_t instruction) {
+    // Appends an instruction to an image in the big-endian layout of .bin files, returns the new size
+
+    image[size] = instruction >> 24;
+    image[size + 1] = instruction >> 16;
+    image[size + 2] = instruction >> 8;
+    image[size + 3] = instruction;
+
+    return size + 4;
+
+}
+
+void printHeader() {
+    // Prints the column names of the results
+
+    if(CSV) printf("type,name,engine,instructions,seconds,mips,ns_per_instruction\n");
+    else printf("%-8s %-32s %-9s %14s %12s %10s %10s\n", "Type", "Name", "Engine", "Instructions", "Seconds", "MIPS", "ns/instr");
+
+}
+
+void printResult(char* type, const char* name, uint8_t engine, uint64_t instructions, double seconds) {
+    // Prints one line of results
+
+    double mips = seconds > 0 ? instructions / seconds / 1e6 : 0;
+    double nsPerInstruction = instructions ? seconds * 1e9 / instructions : 0;
+
+    if(CSV) printf("%s,%s,%s,%llu,%.6f,%.2f,%.3f\n", type, name, ENGINE_NAMES[engine], (unsigned long long) instructions, seconds, mips, nsPerInstruction);
+    else printf("%-8s %-32s %-9s %14llu %12.6f %10.2f %10.3f\n", type, name, ENGINE_NAMES[engine], (unsigned long long) instructions, seconds, mips, nsPerInstruction);
+
+    fflush(stdout);
+
+}
+
+bool containsOnlyNums(char* str) {
+    // Checks if a given string contains only numerical digit characters
+
+    while(*str) {
+
+        if(*str < '0' || *str > '9') return false;
+        str++;
+
+    }
+
+    return true;
+
+}
+
+bool endsWith(char* str, char* substr) {
+    // Checks if a given string ends with a given substring
+
+    int strlen = strnlen(str, MAX_STRING_LEN);
+    int substrlen = strnlen(substr, MAX_STRING_LEN);
+
+    if(strlen < substrlen) return false;
+
+    str += (strlen - substrlen);
+
+    return !strncmp(str, substr, MAX_STRING_LEN);
+
+}
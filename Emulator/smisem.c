@@ -3,157 +3,290 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <arpa/inet.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "libsmisem.h"
 
-#define USAGE "Usage: ./smisem <executable .bin file>\n"
+
+#define USAGE "Usage: ./smisem [--quiet | --trace=<level>] [--engine=switch|threaded|blocks|jit] [--max-steps=<n>] [--max-time=<ms>]\n" \
+    "                [--trace-file=<file>] [--snapshot-at=<n>|<label>] [--record=<file> [--checkpoint-every=<n>]] [--dump-state]\n" \
+    "                [--profile] <executable .bin file or .snp snapshot>\n" \
+    "       ./smisem --replay=<recording> [--seek=<n>] [--quiet | --trace=<level>] [--max-steps=<n>] [--dump-state] [--profile]\n" \
+    "       ./smisem --batch <list .txt file> [-j <threads>] [--engine=switch|threaded|blocks|jit] [--max-steps=<n>] [--max-time=<ms>]\n" \
+    "       ./smisem --sweep <inputs .txt file> [-j <threads>] [--engine=switch|threaded|blocks|jit] [--max-steps=<n>] [--max-time=<ms>]\n" \
+    "                [--dump-state] <executable .bin file or .snp snapshot>\n"
 #define MAX_STRING_LEN 500
+#define TRACE_BUFFER_SIZE 0x10000
 
-#define MEM MEMORY
-#define REG REGISTERS
-#define RZR REGISTERS[0x0]
-#define RSP REGISTERS[0xF]
-#define RBP REGISTERS[0xE]
-#define RLR REGISTERS[0xD]
+#define ENGINE_DEFAULT -1
 
-#define PC PROGRAM_COUNTER
-#define IR INSTRUCTION_REGISTER
+#define EXIT_BUDGET_EXHAUSTED 2
+// Exit code for a program stopped by --max-steps or --max-time, kept apart from the -1 of real errors
 
-#define ZF ZERO_FLAG
-#define SF SIGN_FLAG
+#define PROFILE_HOT_ADDRESSES 20
 
-#define OP_SET              1
-#define OP_COPY             2
+#define RECORDING_VERSION 1
+#define DEFAULT_CHECKPOINT_EVERY 100000000
+// Recorded runs are checkpointed about every 0.3 seconds of emulation, so seeking never has to run for longer than that
+#define SEEK_NONE UINT64_MAX
 
-#define OP_ADD              3
-#define OP_SUBTRACT         4
-#define OP_MULTIPLY         5
-#define OP_DIVIDE           6
-#define OP_MODULO           7
+#define TRACE_RING_SLOTS 256
+// Binary trace chunks wait in a 16MB ring for the writer thread, the emulator only stalls if the disk falls that far behind
 
-#define OP_COMPARE          8
 
-#define OP_SHIFT_LEFT       9
-#define OP_SHIFT_RIGHT      10
+typedef struct BatchJob {
 
-#define OP_AND              11
-#define OP_OR               12
-#define OP_XOR              13
-#define OP_NAND             14
-#define OP_NOR              15
-#define OP_NOT              16
+    char* binfile;
+    // The program of a batch job, or the line of inputs of a sweep job
+    bool loaded;
+    uint8_t status;
+    uint16_t finalPC;
+    uint64_t steps;
+    uint32_t checksum;
+    uint16_t registers[0x10];
+    double runTime;
 
-#define OP_ADD_IMM          17
-#define OP_SUBTRACT_IMM     18
-#define OP_MULTIPLY_IMM     19
-#define OP_DIVIDE_IMM       20
-#define OP_MODULO_IMM       21
+} BatchJob;
+// One program of a batch run, along with the results collected for the report
 
-#define OP_COMPARE_IMM      22
-#define OP_SHIFT_LEFT_IMM   23
-#define OP_SHIFT_RIGHT_IMM  24
-#define OP_AND_IMM          25
-#define OP_OR_IMM           26
-#define OP_XOR_IMM          27
-#define OP_NAND_IMM         28
-#define OP_NOR_IMM          29
+typedef struct Label {
 
-#define OP_LOAD             30
-#define OP_STORE            31
+    char* labelName;
+    uint16_t PCAddress;
 
-#define OP_JUMP             32
-#define OP_JUMP_IF_ZERO     33
-#define OP_JUMP_IF_NOTZERO  34
-#define OP_JUMP_LINK        35
+} Label;
+// A label read from the .sym file written by smisasm --symbols
 
-#define OP_HALT             36
+typedef struct HotAddress {
 
+    uint16_t addr;
+    uint64_t executions;
 
-uint16_t MEMORY[0xFFFF];
-uint16_t REGISTERS[0xF];
+} HotAddress;
+// An executed address and its count, for sorting the profile
 
-uint16_t PROGRAM_COUNTER = 0;
-uint32_t INSTRUCTION_REGISTER = 0;
+typedef struct TraceRing {
 
-bool ZERO_FLAG = false;
-bool SIGN_FLAG = false;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    pthread_cond_t emptied;
+    uint64_t head;
+    uint64_t tail;
+    // Chunks [head, tail) are waiting to be written, each in slot index % TRACE_RING_SLOTS
+    bool finished;
 
+    FILE* file;
+    pthread_t writer;
+    size_t sizes[TRACE_RING_SLOTS];
+    uint8_t slots[TRACE_RING_SLOTS][SMIS_TRACE_CHUNK_SIZE];
 
-void loadProgram(char* binfile);
-void executeProgram();
-void executeInstruction();
-void grabNextInstruction();
-// Program control functions
+} TraceRing;
+// Binary trace chunks on their way from the emulator to the trace file
+
+typedef struct Checkpoint {
+
+    uint64_t steps;
+    char* snapfile;
+
+} Checkpoint;
+// A snapshot taken during a recorded run, after the given number of instructions
+
+typedef struct Recording {
+
+    char* binfile;
+    uint32_t checksum;
+    // The program that was run and its memory checksum right after loading
+
+    Checkpoint* checkpoints;
+    uint32_t checkpointCount;
+    // In order of steps
 
-void setFlags(uint16_t result);
+    uint64_t endSteps;
+    uint8_t endStatus;
+    // Where and why the recorded run stopped, which is the only thing about it that a time budget makes unpredictable
 
-bool RType(uint32_t instruction);
-bool IType(uint32_t instruction);
-bool JType(uint32_t instruction);
+} Recording;
+// A run written by --record and read back by --replay
 
-void SET(uint8_t rDest, uint16_t iVal);
-void COPY(uint8_t rDest, uint8_t rSrc);
+typedef struct WorkQueue {
 
-void ADD(uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
-void SUBTRACT(uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
-void MULTIPLY(uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
-void DIVIDE(uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
-void MODULO(uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
+    pthread_mutex_t lock;
+    uint32_t head;
+    uint32_t tail;
 
-void COMPARE(uint8_t rOp1, uint8_t rOp2);
+} WorkQueue;
+// The range of job indices [head, tail) still owned by one worker thread
 
-void SHIFT_LEFT(uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
-void SHIFT_RIGHT(uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
 
-void AND(uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
-void OR(uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
-void XOR(uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
-void NAND(uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
-void NOR(uint8_t rDest, uint8_t rOp1, uint8_t rOp2);
-void NOT(uint8_t rDest, uint8_t rOp);
+int ENGINE = ENGINE_DEFAULT;
+// The engine given on the command line, machines keep the library's default otherwise
 
-void ADD_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
-void SUBTRACT_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
-void MULTIPLY_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
-void DIVIDE_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
-void MODULO_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
+bool DUMP_STATE = false;
+bool PROFILE = false;
 
-void COMPARE_IMM(uint8_t rOp1, uint16_t iOp2);
+Label* SYMBOL_TABLE = NULL;
+uint32_t SYMBOL_COUNT = 0;
+// Labels of the program being profiled, sorted by address
 
-void SHIFT_LEFT_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
-void SHIFT_RIGHT_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
+uint64_t MAX_STEPS = 0;
+uint64_t MAX_TIME = 0;
+// Budgets given on the command line, 0 leaves programs unlimited
 
-void AND_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
-void OR_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
-void XOR_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
-void NAND_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
-void NOR_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2);
+uint8_t TRACE_LEVEL = SMIS_TRACE_MNEMONICS;
+// Tracing is written to a fully-buffered stream so it never forces a syscall per instruction
+char TRACE_BUFFER[TRACE_BUFFER_SIZE];
 
-void LOAD(uint8_t rDest, uint8_t rBase, uint16_t iOffset);
-void STORE(uint8_t rSrc, uint8_t rBase, uint16_t iOffset);
+char* TRACE_FILE = NULL;
+TraceRing* TRACE_RING = NULL;
 
-void JUMP(uint16_t destAddr);
-void JUMP_IF_ZERO(uint16_t destAddr);
-void JUMP_IF_NOTZERO(uint16_t destAddr);
-void JUMP_LINK(uint16_t destAddr);
+char* SNAPSHOT_AT = NULL;
+// An instruction count or a label name, the program is snapshotted into a .snp file next to it when it gets there
 
-void HALT();
-// Instruction execution functions
+char* RECORD_FILE = NULL;
+uint64_t CHECKPOINT_EVERY = DEFAULT_CHECKPOINT_EVERY;
+char* REPLAY_FILE = NULL;
+uint64_t SEEK_STEP = SEEK_NONE;
+Recording REPLAY;
 
-uint8_t getOpcode(uint32_t instruction);
-uint16_t getInstructionHalf1(uint32_t instruction);
-uint16_t getInstructionHalf2(uint32_t instruction);
-uint8_t getRegOperand(uint32_t instruction, uint8_t opNum);
-uint16_t getDestOrImmVal(uint32_t instruction);
-// Emulator utility functions
+SmisMachine* SWEEP_PARENT = NULL;
+// The loaded program that every job of a sweep is forked from
 
+BatchJob* BATCH_JOBS = NULL;
+uint32_t BATCH_JOB_COUNT = 0;
+WorkQueue* WORK_QUEUES = NULL;
+int WORKER_COUNT = 0;
+
+const char* STATUS_NAMES[] = {
+
+    [SMIS_STATUS_RUNNING] = "running",
+    [SMIS_STATUS_HALTED] = "halted",
+    [SMIS_STATUS_UNKNOWN_INSTRUCTION] = "unknown-instruction",
+    [SMIS_STATUS_DIVIDE_BY_ZERO] = "divide-by-zero",
+    [SMIS_STATUS_BUDGET_EXHAUSTED] = "budget-exhausted",
+    [SMIS_STATUS_BREAKPOINT] = "breakpoint"
+
+};
+// Status names for the batch report, indexed by machine status
+
+
+SmisMachine* createMachine();
+void selectEngine(uint8_t engine, char* name);
+void dumpState(SmisMachine* m);
+bool loadProgram(SmisMachine* m, char* binfile);
+uint8_t runToSnapshot(SmisMachine* m, char* binfile);
+// Program control functions
+
+uint8_t runRecorded(SmisMachine* m, char* binfile);
+void readRecording(char* recfile);
+uint8_t replayRecording(SmisMachine* m);
+uint8_t getStatusNum(char* name);
+// Record and replay functions
+
+void printProfile(SmisMachine* m, char* binfile);
+void readSymbols(char* binfile);
+void printLocation(uint16_t addr);
+int compareLabels(const void* a, const void* b);
+int compareHotAddresses(const void* a, const void* b);
+// Profiling functions
+
+void startTraceWriter(char* tracefile);
+void traceSink(void* context, const uint8_t* chunk, size_t size);
+void* traceWriter(void* arg);
+void finishTraceWriter();
+// Binary trace functions
+
+void runBatch(char* listfile, int workers);
+void* batchWorker(void* arg);
+bool takeJob(int worker, uint32_t* job);
+void runBatchJob(SmisMachine* m, BatchJob* job);
+bool setInputs(SmisMachine* m, char* inputs);
+// Batch and sweep mode functions
+
+bool containsOnlyNums(char* str);
 bool endsWith(char* str, char* substr);
 // General utility functions
 
 
 int main(int argc, char** argv) {
 
-    if(argc != 2) {
+    char* binfile = NULL;
+    char* listfile = NULL;
+    char* inputsfile = NULL;
+    int workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for(int arg = 1; arg < argc; arg++) {
+
+        if(!strncmp(argv[arg], "--quiet", MAX_STRING_LEN)) TRACE_LEVEL = SMIS_TRACE_NONE;
+        else if(!strncmp(argv[arg], "--trace=", 8) && containsOnlyNums(argv[arg] + 8) && argv[arg][8]) {
+
+            TRACE_LEVEL = strtol(argv[arg] + 8, NULL, 10);
+
+            if(TRACE_LEVEL > SMIS_TRACE_STATE) TRACE_LEVEL = SMIS_TRACE_STATE;
+
+        } else if(!strncmp(argv[arg], "--engine=switch", MAX_STRING_LEN)) selectEngine(SMIS_ENGINE_SWITCH, "switch");
+        else if(!strncmp(argv[arg], "--engine=threaded", MAX_STRING_LEN)) selectEngine(SMIS_ENGINE_THREADED, "threaded");
+        else if(!strncmp(argv[arg], "--engine=jit", MAX_STRING_LEN)) selectEngine(SMIS_ENGINE_JIT, "JIT");
+        else if(!strncmp(argv[arg], "--engine=blocks", MAX_STRING_LEN)) selectEngine(SMIS_ENGINE_BLOCKS, "blocks");
+        else if(!strncmp(argv[arg], "--dump-state", MAX_STRING_LEN)) DUMP_STATE = true;
+        else if(!strncmp(argv[arg], "--profile", MAX_STRING_LEN)) PROFILE = true;
+        else if(!strncmp(argv[arg], "--trace-file=", 13) && argv[arg][13]) TRACE_FILE = argv[arg] + 13;
+        else if(!strncmp(argv[arg], "--snapshot-at=", 14) && argv[arg][14]) SNAPSHOT_AT = argv[arg] + 14;
+        else if(!strncmp(argv[arg], "--record=", 9) && argv[arg][9]) RECORD_FILE = argv[arg] + 9;
+        else if(!strncmp(argv[arg], "--replay=", 9) && argv[arg][9]) REPLAY_FILE = argv[arg] + 9;
+        else if(!strncmp(argv[arg], "--checkpoint-every=", 19) && containsOnlyNums(argv[arg] + 19)
+            && strtoull(argv[arg] + 19, NULL, 10) > 0) {
+
+            CHECKPOINT_EVERY = strtoull(argv[arg] + 19, NULL, 10);
+
+        } else if(!strncmp(argv[arg], "--seek=", 7) && containsOnlyNums(argv[arg] + 7) && argv[arg][7]) {
+
+            SEEK_STEP = strtoull(argv[arg] + 7, NULL, 10);
+
+        }
+        else if(!strncmp(argv[arg], "--max-steps=", 12) && containsOnlyNums(argv[arg] + 12) && argv[arg][12]) {
+
+            MAX_STEPS = strtoull(argv[arg] + 12, NULL, 10);
+
+        } else if(!strncmp(argv[arg], "--max-time=", 11) && containsOnlyNums(argv[arg] + 11) && argv[arg][11]) {
+
+            MAX_TIME = strtoull(argv[arg] + 11, NULL, 10);
+
+        }
+        else if(!strncmp(argv[arg], "--batch", MAX_STRING_LEN) && !listfile && arg + 1 < argc) listfile = argv[++arg];
+        else if(!strncmp(argv[arg], "--sweep", MAX_STRING_LEN) && !inputsfile && arg + 1 < argc) inputsfile = argv[++arg];
+        else if(!strncmp(argv[arg], "-j", MAX_STRING_LEN) && arg + 1 < argc
+            && containsOnlyNums(argv[arg + 1]) && strtol(argv[arg + 1], NULL, 10) > 0) {
+
+            workers = strtol(argv[++arg], NULL, 10);
+
+        } else if(!binfile && strncmp(argv[arg], "-", 1)) binfile = argv[arg];
+        else {
+
+            printf("Unknown or repeated argument %s.\n", argv[arg]);
+            printf(USAGE);
+            exit(-1);
+
+        }
+
+    }
+
+    if(listfile && !binfile && !inputsfile) {
+
+        runBatch(listfile, workers > 0 ? workers : 1);
+        return 0;
+
+    }
+
+    if(REPLAY_FILE && !binfile && !listfile && !inputsfile && !RECORD_FILE && !SNAPSHOT_AT) {
+
+        readRecording(REPLAY_FILE);
+        binfile = REPLAY.binfile;
+
+    }
+
+    if(!binfile || listfile || (SEEK_STEP != SEEK_NONE && !REPLAY_FILE) || (RECORD_FILE && SNAPSHOT_AT)) {
 
         printf("Incorrect number of arguments supplied.\n");
         printf(USAGE);
@@ -161,7 +294,7 @@ int main(int argc, char** argv) {
 
     }
 
-    if(!endsWith(argv[1], ".bin")) {
+    if(!endsWith(binfile, ".bin") && !endsWith(binfile, ".snp")) {
 
         printf("The supplied file does not have the correct extension.\n");
         printf(USAGE);
@@ -169,624 +302,912 @@ int main(int argc, char** argv) {
 
     }
 
-    loadProgram(argv[1]);
-    executeProgram();
-    
-}
+    if(inputsfile) {
+
+        SWEEP_PARENT = smisCreate();
+
+        if(!SWEEP_PARENT || !loadProgram(SWEEP_PARENT, binfile)) {
 
-void loadProgram(char* binfile) {
-    // Reads the binary file and places it in the memory array
+            printf("File %s does not exist, is too large or is not a snapshot.\n", binfile);
+            printf(USAGE);
+            exit(-1);
 
-    FILE* program;
+        }
 
-    if(!(program = fopen(binfile, "rb"))) {
+        runBatch(inputsfile, workers > 0 ? workers : 1);
+        return 0;
+
+    }
+
+    if(TRACE_FILE) TRACE_LEVEL = SMIS_TRACE_BINARY;
+
+    if(TRACE_LEVEL != SMIS_TRACE_NONE && TRACE_LEVEL != SMIS_TRACE_BINARY) setvbuf(stdout, TRACE_BUFFER, _IOFBF, TRACE_BUFFER_SIZE);
+    // The trace is flushed in large blocks rather than once per line
+
+    SmisMachine* m = createMachine();
+
+    smisSetTrace(m, TRACE_LEVEL, stdout);
+
+    if(TRACE_FILE) {
+
+        startTraceWriter(TRACE_FILE);
+        smisSetTraceSink(m, traceSink, TRACE_RING);
+
+    }
+
+    if(PROFILE && !smisSetProfiling(m, true)) {
+
+        printf("Could not allocate memory for the profiler.\n");
+        exit(-1);
+
+    }
 
-        printf("File %s does not exist.\n", binfile);
+    if(!loadProgram(m, binfile)) {
+
+        printf("File %s does not exist, is too large or is not a snapshot.\n", binfile);
         printf(USAGE);
         exit(-1);
 
     }
 
-    uint32_t instruction;
+    uint8_t status;
+
+    if(REPLAY_FILE) status = replayRecording(m);
+    else if(RECORD_FILE) status = runRecorded(m, binfile);
+    else if(SNAPSHOT_AT) status = runToSnapshot(m, binfile);
+    else status = smisRun(m, 0);
+    uint16_t pc = smisGetPC(m);
 
-    uint16_t storeAddr = 0;
-    
-    while(fread(&instruction, 4, 1, program)) {
+    if(TRACE_FILE) finishTraceWriter();
 
-        instruction = ntohl(instruction);
+    if(PROFILE) printProfile(m, binfile);
 
-        MEM[storeAddr] = getInstructionHalf1(instruction);
-        MEM[storeAddr + 1] = getInstructionHalf2(instruction);
-        // Split the instruction into two 16-bit segments to put in memory
+    if(status == SMIS_STATUS_UNKNOWN_INSTRUCTION) {
 
-        storeAddr += 2;
+        printf("Unknown instruction 0x%.8X at PC address 0x%.4X\n",
+            (uint32_t) smisReadMemory(m, pc) << 16 | smisReadMemory(m, pc + 1), pc);
+        exit(-1);
 
     }
-    
-    MEM[storeAddr] = OP_HALT << 8;
-    // Add a HALT to the end, in case the ASM programmer forgot to do so
 
-    fclose(program);
+    if(status == SMIS_STATUS_DIVIDE_BY_ZERO) {
 
-}
+        printf("Division by zero at PC address 0x%.4X\n", pc);
+        exit(-1);
 
-void executeProgram() {
-    // Calls each instruction in the program until reaching a HALT signal
+    }
 
-    do {
+    if(status == SMIS_STATUS_BUDGET_EXHAUSTED) {
 
-        grabNextInstruction();
-        PC += 2;
-        // PC is incremented prior to executing instruction so it does not interfere with J-Type instructions
-        executeInstruction();
+        printf("Budget exhausted after %llu instructions at PC address 0x%.4X\n", (unsigned long long) smisGetSteps(m), pc);
+        dumpState(m);
+        exit(EXIT_BUDGET_EXHAUSTED);
 
-        RZR = 0x0000;
+    }
 
-    } while(IR != 0x00000000);
+    if(DUMP_STATE) dumpState(m);
 
 }
 
-void executeInstruction() {
-    // Executes the instruction held in the instruction register
+SmisMachine* createMachine() {
+    // Creates a machine set up with the engine and budgets chosen on the command line
 
-    if(RType(IR)) return;
-    else if(IType(IR)) return;
-    else if(JType(IR)) return;
+    SmisMachine* m = smisCreate();
 
-    printf("Unknown instruction 0x%.8X at PC address 0x%.4X\n", IR, PC);
-    exit(-1);
+    if(!m) {
+
+        printf("Could not allocate memory for the machine.\n");
+        exit(-1);
+
+    }
+
+    if(ENGINE != ENGINE_DEFAULT) smisSetEngine(m, ENGINE);
+
+    smisSetBudget(m, MAX_STEPS, MAX_TIME);
+
+    return m;
 
 }
 
-void grabNextInstruction() {
-    // Gets the next instruction from memory and places it in the instruction register
+void selectEngine(uint8_t engine, char* name) {
+    // Selects the engine for every machine, if it is part of this build
+
+    if(!smisEngineAvailable(engine)) {
 
-    IR = 0;
+        printf("This build of smisem does not include the %s engine.\n", name);
+        exit(-1);
+
+    }
 
-    IR ^= MEM[PC] << 16;
-    IR ^= MEM[PC + 1];
+    ENGINE = engine;
 
 }
 
-void setFlags(uint16_t result) {
-    // Sets flags according to the given value, usually the result of an arithmetic operation
+bool loadProgram(SmisMachine* m, char* binfile) {
+    // Loads a .bin program, or restores a .snp snapshot to carry on from where it was taken
 
-    if(result == 0x0000) ZF = true;
-    else ZF = false;
+    if(endsWith(binfile, ".snp")) return smisLoadSnapshot(m, binfile);
 
-    if(result >> 15 == 0x1) SF = true;
-    else SF = false;
+    return smisLoadFile(m, binfile);
 
 }
 
-bool RType(uint32_t instruction) {
-    // Executes a given R-Type instruction
-    // Returns true if the instruction is valid for R-Type, false if it is invalid
+uint8_t runToSnapshot(SmisMachine* m, char* binfile) {
+    // Runs the program up to the --snapshot-at point, saves a snapshot next to it there and then runs the rest of it
+    // The point is either a total instruction count, or a label from the .sym file that is reached once a jump lands on it
+    // Returns the status the run finished with
+
+    bool atLabel = !containsOnlyNums(SNAPSHOT_AT);
+    uint64_t snapshotSteps = atLabel ? 0 : strtoull(SNAPSHOT_AT, NULL, 10);
+    uint64_t startSteps = smisGetSteps(m);
+
+    if(atLabel) {
+
+        readSymbols(binfile);
+
+        int32_t label = SYMBOL_COUNT - 1;
+
+        while(label >= 0 && strncmp(SYMBOL_TABLE[label].labelName, SNAPSHOT_AT, MAX_STRING_LEN)) label--;
 
-    uint8_t opcode = getOpcode(IR);
+        if(label < 0) {
 
-    uint8_t rDest = getRegOperand(IR, 1);
-    uint8_t rOp1 = getRegOperand(IR, 2);
-    uint8_t rOp2 = getRegOperand(IR, 3);
+            printf("Label %s is not in the .sym file next to %s.\n", SNAPSHOT_AT, binfile);
+            exit(-1);
 
-    switch(opcode) {
+        }
 
-        case OP_COPY: COPY(rDest, rOp1); break;
+        smisSetBreakpoint(m, true, SYMBOL_TABLE[label].PCAddress);
 
-        case OP_ADD: ADD(rDest, rOp1, rOp2); break;
-        case OP_SUBTRACT: SUBTRACT(rDest, rOp1, rOp2); break;
-        case OP_MULTIPLY: MULTIPLY(rDest, rOp1, rOp2); break;
-        case OP_DIVIDE: DIVIDE(rDest, rOp1, rOp2); break;
-        case OP_MODULO: MODULO(rDest, rOp1, rOp2); break;
+    } else smisSetBudget(m, MAX_STEPS && MAX_STEPS < snapshotSteps - startSteps ? MAX_STEPS : snapshotSteps - startSteps, MAX_TIME);
+    // A budget stop is the snapshot point unless the --max-steps budget comes first
 
-        case OP_COMPARE: COMPARE(rOp1, rOp2); break;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-        case OP_SHIFT_LEFT: SHIFT_LEFT(rDest, rOp1, rOp2); break;
-        case OP_SHIFT_RIGHT: SHIFT_RIGHT(rDest, rOp1, rOp2); break;
-            
-        case OP_AND: AND(rDest, rOp1, rOp2); break;
-        case OP_OR: OR(rDest, rOp1, rOp2); break;
-        case OP_XOR: XOR(rDest, rOp1, rOp2); break;
-        case OP_NAND: NAND(rDest, rOp1, rOp2); break;
-        case OP_NOR: NOR(rDest, rOp1, rOp2); break;
-        case OP_NOT: NOT(rDest, rOp1); break;
+    uint8_t status = !atLabel && snapshotSteps <= startSteps ? SMIS_STATUS_RUNNING : smisRun(m, 0);
 
-        default: return false;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    smisSetBreakpoint(m, false, 0);
+
+    uint64_t usedSteps = smisGetSteps(m) - startSteps;
+    uint64_t usedTime = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+
+    if(atLabel ? status != SMIS_STATUS_BREAKPOINT : status != SMIS_STATUS_RUNNING && (status != SMIS_STATUS_BUDGET_EXHAUSTED
+        || smisGetSteps(m) < snapshotSteps)) {
+
+        printf("The program stopped before the snapshot point, no snapshot was written.\n");
+        smisSetBudget(m, MAX_STEPS, MAX_TIME);
+        return status;
 
     }
 
-    return true;
+    char snapfile[MAX_STRING_LEN];
+
+    snprintf(snapfile, MAX_STRING_LEN, "%.*s.snp", (int) strnlen(binfile, MAX_STRING_LEN) - 4, binfile);
+
+    if(!smisSaveSnapshot(m, snapfile)) {
+
+        printf("Could not write the snapshot to %s.\n", snapfile);
+        exit(-1);
+
+    }
+
+    printf("Snapshot after %llu instructions at PC address 0x%.4X written to %s\n", (unsigned long long) smisGetSteps(m),
+        smisGetPC(m), snapfile);
+
+    smisSetBudget(m, MAX_STEPS ? (MAX_STEPS > usedSteps ? MAX_STEPS - usedSteps : 1) : 0,
+        MAX_TIME ? (MAX_TIME > usedTime ? MAX_TIME - usedTime : 1) : 0);
+    // The rest of the run gets whatever is left of the budgets
+
+    return smisRun(m, 0);
 
 }
 
-bool IType(uint32_t instruction) {
-    // Executes a given I-Type instruction
-    // Returns true if the instruction is valid for I-Type, false if it is invalid
+uint8_t runRecorded(SmisMachine* m, char* binfile) {
+    // Runs the program while saving a checkpoint every CHECKPOINT_EVERY instructions, and writes a recording of the run
+    // that --replay can use to get back to any point of it
+    // The run is split up with step budgets, which stop it at jumps and let it carry on exactly where it was
+    // Returns the status the run finished with
+
+    FILE* recording;
+
+    if(!(recording = fopen(RECORD_FILE, "w"))) {
+
+        printf("Could not write the recording to %s.\n", RECORD_FILE);
+        exit(-1);
+
+    }
+
+    fprintf(recording, "SMIS recording %i\nprogram %s\nchecksum 0x%.8X\n", RECORDING_VERSION, binfile, smisMemoryChecksum(m));
+
+    uint64_t startSteps = smisGetSteps(m);
+    uint32_t checkpoint = 0;
+    uint8_t status;
 
-    uint8_t opcode = getOpcode(IR);
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-    uint8_t rDest = getRegOperand(IR, 1);
-    uint8_t rOp1 = getRegOperand(IR, 2);
-    uint8_t iOp2 = getDestOrImmVal(IR);
+    while(true) {
 
-    switch(opcode) {
+        uint64_t steps = smisGetSteps(m);
+        uint64_t nextCheckpoint = (steps / CHECKPOINT_EVERY + 1) * CHECKPOINT_EVERY;
+        bool stepBudgetFirst = MAX_STEPS && startSteps + MAX_STEPS <= nextCheckpoint;
 
-        case OP_SET: SET(rDest, iOp2); break;
-            
-        case OP_ADD_IMM: ADD_IMM(rDest, rOp1, iOp2); break;
-        case OP_SUBTRACT_IMM: SUBTRACT_IMM(rDest, rOp1, iOp2); break;
-        case OP_MULTIPLY_IMM: MULTIPLY_IMM(rDest, rOp1, iOp2); break;
-        case OP_DIVIDE_IMM: DIVIDE_IMM(rDest, rOp1, iOp2); break;
-        case OP_MODULO_IMM: MODULO_IMM(rDest, rOp1, iOp2); break;
+        clock_gettime(CLOCK_MONOTONIC, &now);
 
-        case OP_COMPARE_IMM: COMPARE_IMM(rOp1, iOp2); break;
+        uint64_t usedTime = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
 
-        case OP_SHIFT_LEFT_IMM: SHIFT_LEFT_IMM(rDest, rOp1, iOp2); break;
-        case OP_SHIFT_RIGHT_IMM: SHIFT_RIGHT_IMM(rDest, rOp1, iOp2); break;
+        smisSetBudget(m, stepBudgetFirst ? startSteps + MAX_STEPS - steps : nextCheckpoint - steps,
+            MAX_TIME ? (MAX_TIME > usedTime ? MAX_TIME - usedTime : 1) : 0);
+        // Whichever comes first of the next checkpoint and what is left of the --max-steps and --max-time budgets
 
-        case OP_AND_IMM: AND_IMM(rDest, rOp1, iOp2); break;
-        case OP_OR_IMM: OR_IMM(rDest, rOp1, iOp2); break;
-        case OP_XOR_IMM: XOR_IMM(rDest, rOp1, iOp2); break;
-        case OP_NAND_IMM: NAND_IMM(rDest, rOp1, iOp2); break;
-        case OP_NOR_IMM: NOR_IMM(rDest, rOp1, iOp2); break;
+        status = smisRun(m, 0);
 
-        case OP_LOAD: LOAD(rDest, rOp1, iOp2); break;
-        case OP_STORE: STORE(rDest, rOp1, iOp2); break;
+        if(status != SMIS_STATUS_BUDGET_EXHAUSTED || stepBudgetFirst || smisGetSteps(m) < nextCheckpoint) break;
 
-        default: return false;
+        char snapfile[MAX_STRING_LEN];
+
+        snprintf(snapfile, MAX_STRING_LEN, "%s.%u.snp", RECORD_FILE, ++checkpoint);
+
+        if(!smisSaveSnapshot(m, snapfile)) {
+
+            printf("Could not write the checkpoint to %s.\n", snapfile);
+            exit(-1);
+
+        }
+
+        fprintf(recording, "checkpoint %llu %s\n", (unsigned long long) smisGetSteps(m), snapfile);
 
     }
 
-    return true;
+    fprintf(recording, "end %llu %s\n", (unsigned long long) smisGetSteps(m), STATUS_NAMES[status]);
+
+    if(fclose(recording)) {
+
+        printf("Could not write the recording to %s.\n", RECORD_FILE);
+        exit(-1);
+
+    }
+
+    smisSetBudget(m, MAX_STEPS, MAX_TIME);
+
+    return status;
 
 }
 
-bool JType(uint32_t instruction) {
-    // Executes a given J-Type instruction
-    // Returns true if the instruction is valid for J-Type, false if it is invalid
+void readRecording(char* recfile) {
+    // Reads a recording written by --record into REPLAY, terminating the program if it is not one
 
-    uint8_t opcode = getOpcode(IR);
+    FILE* recording;
 
-    uint8_t destAddr = getDestOrImmVal(IR);
+    if(!(recording = fopen(recfile, "r"))) {
 
-    switch(opcode) {
+        printf("File %s does not exist.\n", recfile);
+        printf(USAGE);
+        exit(-1);
 
-        case OP_JUMP: JUMP(destAddr); break;
-        case OP_JUMP_IF_ZERO: JUMP_IF_ZERO(destAddr); break;
-        case OP_JUMP_IF_NOTZERO: JUMP_IF_NOTZERO(destAddr); break;
-        case OP_JUMP_LINK: JUMP_LINK(destAddr); break;
+    }
+
+    char line[MAX_STRING_LEN];
+    char name[MAX_STRING_LEN];
+    int version = 0;
+    unsigned long long steps;
+    bool ended = false;
 
-        case OP_HALT: HALT(); break;
+    if(!fgets(line, MAX_STRING_LEN, recording) || sscanf(line, "SMIS recording %i", &version) != 1 || version != RECORDING_VERSION) {
 
-        default: return false;
+        printf("File %s is not a recording made by this version of smisem.\n", recfile);
+        exit(-1);
 
     }
 
-    return true;
+    while(fgets(line, MAX_STRING_LEN, recording)) {
 
-}
+        line[strcspn(line, "\r\n")] = '\0';
 
-void SET(uint8_t rDest, uint16_t iVal) {
-    // Executes a SET instruction
+        if(sscanf(line, "program %499[^\n]", name) == 1) REPLAY.binfile = strdup(name);
+        else if(sscanf(line, "checksum 0x%x", &REPLAY.checksum) == 1) continue;
+        else if(sscanf(line, "checkpoint %llu %499[^\n]", &steps, name) == 2) {
 
-    REG[rDest] = iVal;
+            REPLAY.checkpoints = realloc(REPLAY.checkpoints, (REPLAY.checkpointCount + 1) * sizeof(Checkpoint));
+            REPLAY.checkpoints[REPLAY.checkpointCount++] = (Checkpoint) { .steps = steps, .snapfile = strdup(name) };
 
-    printf("SET\n");
+        } else if(sscanf(line, "end %llu %499s", &steps, name) == 2 && getStatusNum(name) != SMIS_STATUS_RUNNING) {
 
-}
+            REPLAY.endSteps = steps;
+            REPLAY.endStatus = getStatusNum(name);
+            ended = true;
 
-void COPY(uint8_t rDest, uint8_t rSrc) {
-    // Executes a COPY instruction
+        }
+
+    }
 
-    REG[rDest] = REG[rSrc];
+    fclose(recording);
 
-    printf("COPY\n");
+    if(!REPLAY.binfile || !ended) {
+
+        printf("Recording %s is incomplete.\n", recfile);
+        exit(-1);
+
+    }
 
 }
 
-void ADD(uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
-    // Executes an ADD instruction
+uint8_t replayRecording(SmisMachine* m) {
+    // Brings the freshly loaded program of a recording to the --seek point (or the end of the recorded run) by restoring
+    // the last checkpoint before it and running the rest without tracing
+    // After a --seek the program carries on as in a normal run, otherwise it stops where the recorded run stopped
+    // Returns the status the run finished with
 
-    REG[rDest] = REG[rOp1] + REG[rOp2];
+    if(smisMemoryChecksum(m) != REPLAY.checksum) {
 
-    setFlags(REG[rDest]);
+        printf("Program %s has changed since it was recorded.\n", REPLAY.binfile);
+        exit(-1);
 
-    printf("ADD\n");
+    }
 
-}
+    uint64_t target = SEEK_STEP == SEEK_NONE ? REPLAY.endSteps : SEEK_STEP;
 
-void SUBTRACT(uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
-    // Executes a SUBTRACT instruction
+    if(target > REPLAY.endSteps) {
 
-    REG[rDest] = REG[rOp1] - REG[rOp2];
+        printf("The recorded run stopped after %llu instructions.\n", (unsigned long long) REPLAY.endSteps);
+        exit(-1);
 
-    setFlags(REG[rDest]);
+    }
 
-    printf("SUBTRACT\n");
+    int32_t checkpoint = REPLAY.checkpointCount - 1;
 
-}
+    while(checkpoint >= 0 && REPLAY.checkpoints[checkpoint].steps > target) checkpoint--;
 
-void MULTIPLY(uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
-    // Executes a MULTIPLY instruction
+    if(checkpoint >= 0 && !smisLoadSnapshot(m, REPLAY.checkpoints[checkpoint].snapfile)) {
 
-    REG[rDest] = REG[rOp1] * REG[rOp2];
+        printf("Checkpoint %s does not exist or is not a snapshot.\n", REPLAY.checkpoints[checkpoint].snapfile);
+        exit(-1);
 
-    setFlags(REG[rDest]);
+    }
 
-    printf("MULTIPLY\n");
+    smisSetTrace(m, SMIS_TRACE_NONE, stdout);
 
-}
+    uint8_t status = smisRunToStep(m, target);
 
-void DIVIDE(uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
-    // Executes a DIVIDE instruction
+    smisSetTrace(m, TRACE_LEVEL, stdout);
 
-    REG[rDest] = REG[rOp1] / REG[rOp2];
+    if(smisGetSteps(m) != target) {
 
-    setFlags(REG[rDest]);
+        printf("The replay stopped after %llu instructions instead of %llu, it does not match the recording.\n",
+            (unsigned long long) smisGetSteps(m), (unsigned long long) target);
+        exit(-1);
 
-    printf("DIVIDE\n");
+    }
+
+    if(SEEK_STEP != SEEK_NONE) return smisRun(m, 0);
+
+    return status == SMIS_STATUS_RUNNING ? REPLAY.endStatus : status;
 
 }
 
-void MODULO(uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
-    // Executes a MODULO instruction
+uint8_t getStatusNum(char* name) {
+    // Gets the status with a given name in the batch report, or SMIS_STATUS_RUNNING if there is none
 
-    REG[rDest] = REG[rOp1] % REG[rOp2];
+    for(uint8_t status = 0; status < sizeof(STATUS_NAMES) / sizeof(STATUS_NAMES[0]); status++) {
 
-    setFlags(REG[rDest]);
+        if(!strncmp(STATUS_NAMES[status], name, MAX_STRING_LEN)) return status;
+
+    }
 
-    printf("MODULO\n");
+    return SMIS_STATUS_RUNNING;
 
 }
 
-void COMPARE(uint8_t rOp1, uint8_t rOp2) {
-    // Executes a COMPARE instruction
+void dumpState(SmisMachine* m) {
+    // Prints the architectural state of the machine, so runs on different engines can be compared
 
-    uint16_t throwawayVal = REG[rOp1] + REG[rOp2];
+    printf("PC = 0x%.4X  ZF = %i  SF = %i\n", smisGetPC(m), smisGetZeroFlag(m), smisGetSignFlag(m));
 
-    setFlags(throwawayVal);
+    for(int reg = 0; reg < 0x10; reg++) printf("R%i = 0x%.4X%s", reg, smisGetRegister(m, reg), reg % 4 == 3 ? "\n" : "  ");
 
-    printf("COMPARE\n");
+    printf("MEMORY checksum = 0x%.8X\n", smisMemoryChecksum(m));
+    printf("Instructions executed = %llu\n", (unsigned long long) smisGetSteps(m));
 
 }
 
-void SHIFT_LEFT(uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
-    // Executes a SHIFT-LEFT instruction
+void printProfile(SmisMachine* m, char* binfile) {
+    // Prints executions per opcode, per label and for the hottest addresses, with taken counts for conditional jumps
+    // Addresses are shown relative to the labels in the .sym file next to the .bin file, if there is one
 
-    REG[rDest] = REG[rOp1] << REG[rOp2];
+    SmisProfile* profile = malloc(sizeof(SmisProfile));
 
-    setFlags(REG[rDest]);
+    if(!profile || !smisGetProfile(m, profile)) {
 
-    printf("SHIFT-LEFT\n");
+        printf("Could not read the profile.\n");
+        exit(-1);
 
-}
+    }
 
-void SHIFT_RIGHT(uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
-    // Executes a SHIFT-RIGHT instruction
+    readSymbols(binfile);
 
-    REG[rDest] = REG[rOp1] >> REG[rOp2];
+    uint64_t total = 0;
 
-    setFlags(REG[rDest]);
+    for(int opcode = 0; opcode < 0x100; opcode++) total += profile->opcodes[opcode];
 
-    printf("SHIFT-RIGHT\n");
+    double percent = total ? 100.0 / total : 0;
 
-}
+    printf("\nProfile: %llu instructions executed\n\n", (unsigned long long) total);
+    printf("%-18s %14s %8s\n", "Opcode", "Executions", "%");
 
-void AND(uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
-    // Executes an AND instruction
+    for(int opcode = 0; opcode < 0x100; opcode++) {
 
-    REG[rDest] = REG[rOp1] & REG[rOp2];
+        if(!profile->opcodes[opcode]) continue;
 
-    setFlags(REG[rDest]);
+        const char* mnemonic = smisMnemonic(opcode);
 
-    printf("AND\n");
+        printf("%-18s %14llu %7.2f%%\n", mnemonic ? mnemonic : "(unknown)", (unsigned long long) profile->opcodes[opcode],
+            profile->opcodes[opcode] * percent);
 
-}
+    }
 
-void OR(uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
-    // Executes an OR instruction
+    if(SYMBOL_COUNT) {
 
-    REG[rDest] = REG[rOp1] | REG[rOp2];
+        printf("\n%-18s %14s %8s\n", "Label", "Executions", "%");
 
-    setFlags(REG[rDest]);
+        for(uint32_t next = 0; next <= SYMBOL_COUNT; next++) {
 
-    printf("OR\n");
+            uint32_t start = next ? SYMBOL_TABLE[next - 1].PCAddress : 0;
+            uint32_t end = next < SYMBOL_COUNT ? SYMBOL_TABLE[next].PCAddress : 0x10000;
+            uint64_t executions = 0;
 
-}
+            for(uint32_t addr = start; addr < end; addr++) executions += profile->executions[addr];
 
-void XOR(uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
-    // Executes an XOR instruction
+            if(executions) printf("%-18s %14llu %7.2f%%\n", next ? SYMBOL_TABLE[next - 1].labelName : "(before labels)",
+                (unsigned long long) executions, executions * percent);
 
-    REG[rDest] = REG[rOp1] ^ REG[rOp2];
+        }
+        // Each label covers everything up to the next one, so this is the time spent in each routine
+        // next is the label that ends the range, and the range before the first label has none before it
 
-    setFlags(REG[rDest]);
+    }
 
-    printf("XOR\n");
+    HotAddress* hot = malloc(0x10000 * sizeof(HotAddress));
+    uint32_t hotCount = 0;
 
-}
+    for(uint32_t addr = 0; addr < 0x10000; addr++) {
 
-void NAND(uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
-    // Executes a NAND instruction
+        if(profile->executions[addr]) hot[hotCount++] = (HotAddress) { .addr = addr, .executions = profile->executions[addr] };
 
-    REG[rDest] = ~(REG[rOp1] & REG[rOp2]);
+    }
 
-    setFlags(REG[rDest]);
+    qsort(hot, hotCount, sizeof(HotAddress), compareHotAddresses);
 
-    printf("NAND\n");
+    printf("\n%-8s %-24s %-18s %14s %8s %14s %14s\n", "Address", "Location", "Instruction", "Executions", "%", "Taken", "Not taken");
 
-}
+    for(uint32_t i = 0; i < hotCount && i < PROFILE_HOT_ADDRESSES; i++) {
 
-void NOR(uint8_t rDest, uint8_t rOp1, uint8_t rOp2) {
-    // Executes a NOR instruction
+        uint16_t addr = hot[i].addr;
+        const char* mnemonic = smisMnemonic(smisGetOpcode(m, addr));
 
-    REG[rDest] = ~(REG[rOp1] | REG[rOp2]);
+        printf("0x%.4X   ", addr);
+        printLocation(addr);
+        printf(" %-18s %14llu %7.2f%%", mnemonic ? mnemonic : "(unknown)", (unsigned long long) profile->executions[addr],
+            profile->executions[addr] * percent);
 
-    setFlags(REG[rDest]);
+        if(profile->taken[addr] || profile->notTaken[addr]) {
 
-    printf("NOR\n");
+            printf(" %14llu %14llu", (unsigned long long) profile->taken[addr], (unsigned long long) profile->notTaken[addr]);
+
+        }
+
+        printf("\n");
+
+    }
+
+    free(hot);
+    free(profile);
 
 }
 
-void NOT(uint8_t rDest, uint8_t rOp) {
-    // Executes a NOT instruction
+void readSymbols(char* binfile) {
+    // Reads the labels from the .sym file next to a .bin or .snp file into the symbol table, leaving it empty if there is none
+    // The table is only read once, by whichever of the profiler and --snapshot-at needs it first
 
-    REG[rDest] = ~REG[rOp];
+    char symfile[MAX_STRING_LEN];
+    FILE* symFile;
 
-    setFlags(REG[rDest]);
+    snprintf(symfile, MAX_STRING_LEN, "%.*s.sym", (int) strnlen(binfile, MAX_STRING_LEN) - 4, binfile);
 
-    printf("NOT\n");
+    if(SYMBOL_TABLE || !(symFile = fopen(symfile, "r"))) return;
 
-}
+    char line[MAX_STRING_LEN];
+    char name[MAX_STRING_LEN];
+    unsigned int addr;
+
+    while(fgets(line, MAX_STRING_LEN, symFile)) {
 
-void ADD_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
-    // Executes an ADD-IMM instruction
+        if(sscanf(line, "0x%x %499s", &addr, name) != 2 || addr > 0xFFFF) continue;
 
-    REG[rDest] = REG[rOp1] + iOp2;
+        SYMBOL_TABLE = realloc(SYMBOL_TABLE, (SYMBOL_COUNT + 1) * sizeof(Label));
+        SYMBOL_TABLE[SYMBOL_COUNT++] = (Label) { .labelName = strdup(name), .PCAddress = addr };
 
-    setFlags(REG[rDest]);
+    }
+
+    fclose(symFile);
 
-    printf("ADD-IMM result %i\n", REG[rDest]);
+    qsort(SYMBOL_TABLE, SYMBOL_COUNT, sizeof(Label), compareLabels);
 
 }
 
-void SUBTRACT_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
-    // Executes a SUBTRACT-IMM instruction
+void printLocation(uint16_t addr) {
+    // Prints an address as the closest label at or before it plus an offset, padded to a fixed width
 
-    REG[rDest] = REG[rOp1] - iOp2;
+    char location[MAX_STRING_LEN] = "";
 
-    setFlags(REG[rDest]);
+    for(int32_t label = SYMBOL_COUNT - 1; label >= 0; label--) {
 
-    printf("SUBTRACT-IMM\n");
+        if(SYMBOL_TABLE[label].PCAddress > addr) continue;
 
-}
+        if(SYMBOL_TABLE[label].PCAddress == addr) snprintf(location, MAX_STRING_LEN, "%s", SYMBOL_TABLE[label].labelName);
+        else snprintf(location, MAX_STRING_LEN, "%s+0x%X", SYMBOL_TABLE[label].labelName, addr - SYMBOL_TABLE[label].PCAddress);
+
+        break;
 
-void MULTIPLY_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
-    // Executes a MULTIPLY-IMM instruction
+    }
+
+    printf("%-24s", location);
 
-    REG[rDest] = REG[rOp1] * iOp2;
+}
 
-    setFlags(REG[rDest]);
+int compareLabels(const void* a, const void* b) {
+    // Orders labels by address
 
-    printf("MULTIPLY-IMM\n");
+    return ((Label*) a)->PCAddress - ((Label*) b)->PCAddress;
 
 }
 
-void DIVIDE_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
-    // Executes a DIVIDE-IMM instruction
+int compareHotAddresses(const void* a, const void* b) {
+    // Orders addresses by execution count, highest first, and then by address
 
-    REG[rDest] = REG[rOp1] / iOp2;
+    HotAddress* hotA = (HotAddress*) a;
+    HotAddress* hotB = (HotAddress*) b;
 
-    setFlags(REG[rDest]);
+    if(hotA->executions != hotB->executions) return hotA->executions < hotB->executions ? 1 : -1;
 
-    printf("DIVIDE-IMM\n");
+    return hotA->addr - hotB->addr;
 
 }
 
-void MODULO_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
-    // Executes a MODULO-IMM instruction
+void startTraceWriter(char* tracefile) {
+    // Opens the binary trace file and starts the thread that writes chunks to it
 
-    REG[rDest] = REG[rOp1] % iOp2;
+    TRACE_RING = calloc(1, sizeof(TraceRing));
 
-    setFlags(REG[rDest]);
+    if(!TRACE_RING || !(TRACE_RING->file = fopen(tracefile, "wb"))) {
 
-    printf("MODULO-IMM\n");
+        printf("Cannot output to file %s.\n", tracefile);
+        printf(USAGE);
+        exit(-1);
+
+    }
+
+    pthread_mutex_init(&TRACE_RING->lock, NULL);
+    pthread_cond_init(&TRACE_RING->filled, NULL);
+    pthread_cond_init(&TRACE_RING->emptied, NULL);
+
+    pthread_create(&TRACE_RING->writer, NULL, traceWriter, TRACE_RING);
 
 }
 
-void COMPARE_IMM(uint8_t rOp1, uint16_t iOp2) {
-    // Executes a COMPARE-IMM instruction
+void traceSink(void* context, const uint8_t* chunk, size_t size) {
+    // Copies a finished trace chunk into the ring, waiting only if every slot is still waiting to be written
+
+    TraceRing* ring = context;
+
+    pthread_mutex_lock(&ring->lock);
+    while(ring->tail - ring->head == TRACE_RING_SLOTS) pthread_cond_wait(&ring->emptied, &ring->lock);
+    pthread_mutex_unlock(&ring->lock);
 
-    uint16_t throwawayVal = REG[rOp1] - iOp2;
+    uint32_t slot = ring->tail % TRACE_RING_SLOTS;
 
-    setFlags(throwawayVal);
+    memcpy(ring->slots[slot], chunk, size);
+    ring->sizes[slot] = size;
+    // The writer never touches the slot at tail, so it can be filled without holding the lock
 
-    printf("COMPARE-IMM\n");
+    pthread_mutex_lock(&ring->lock);
+    ring->tail++;
+    pthread_cond_signal(&ring->filled);
+    pthread_mutex_unlock(&ring->lock);
 
 }
 
-void SHIFT_LEFT_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
-    // Executes a SHIFT-LEFT-IMM instruction
+void* traceWriter(void* arg) {
+    // Writes chunks from the ring to the trace file until the ring is finished and empty
 
-    REG[rDest] = REG[rOp1] << iOp2;
+    TraceRing* ring = arg;
 
-    setFlags(REG[rDest]);
+    pthread_mutex_lock(&ring->lock);
 
-    printf("SHIFT-LEFT-IMM\n");
+    while(true) {
 
-}
+        while(ring->head == ring->tail && !ring->finished) pthread_cond_wait(&ring->filled, &ring->lock);
+
+        if(ring->head == ring->tail) break;
+
+        uint32_t slot = ring->head % TRACE_RING_SLOTS;
+
+        pthread_mutex_unlock(&ring->lock);
+        fwrite(ring->slots[slot], 1, ring->sizes[slot], ring->file);
+        pthread_mutex_lock(&ring->lock);
 
-void SHIFT_RIGHT_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
-    // Executes a SHIFT-RIGHT-IMM instruction
+        ring->head++;
+        pthread_cond_signal(&ring->emptied);
 
-    REG[rDest] = REG[rOp1] >> iOp2;
+    }
 
-    setFlags(REG[rDest]);
+    pthread_mutex_unlock(&ring->lock);
 
-    printf("SHIFT-RIGHT-IMM\n");
+    return NULL;
 
 }
 
-void AND_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
-    // Executes an AND-IMM instruction
+void finishTraceWriter() {
+    // Waits for every chunk in the ring to be written and closes the trace file
 
-    REG[rDest] = REG[rOp1] & iOp2;
+    pthread_mutex_lock(&TRACE_RING->lock);
+    TRACE_RING->finished = true;
+    pthread_cond_signal(&TRACE_RING->filled);
+    pthread_mutex_unlock(&TRACE_RING->lock);
 
-    setFlags(REG[rDest]);
+    pthread_join(TRACE_RING->writer, NULL);
 
-    printf("AND-IMM\n");
+    fclose(TRACE_RING->file);
 
 }
 
-void OR_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
-    // Executes an OR-IMM instruction
+void runBatch(char* listfile, int workers) {
+    // Runs every program named in a list file (one .bin path per line) on a pool of worker threads, or for a sweep,
+    // runs the sweep program once per line of inputs
+    // Each worker starts with an equal share of the list and steals from the others once its own share runs out
+    // Prints one line per program or line of inputs in list order, followed by a summary
 
-    REG[rDest] = REG[rOp1] | iOp2;
+    FILE* list;
 
-    setFlags(REG[rDest]);
+    if(!(list = fopen(listfile, "r"))) {
 
-    printf("OR-IMM\n");
+        printf("File %s does not exist.\n", listfile);
+        printf(USAGE);
+        exit(-1);
 
-}
+    }
 
-void XOR_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
-    // Executes an XOR-IMM instruction
+    char line[MAX_STRING_LEN];
+    uint32_t capacity = 0;
+    int lineNumber = 0;
 
-    REG[rDest] = REG[rOp1] ^ iOp2;
+    while(fgets(line, MAX_STRING_LEN, list)) {
 
-    setFlags(REG[rDest]);
+        lineNumber++;
+        line[strcspn(line, "\r\n")] = '\0';
 
-    printf("XOR-IMM\n");
+        if(!line[0]) continue;
 
-}
+        if(SWEEP_PARENT && !setInputs(NULL, line)) {
 
-void NAND_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
-    // Executes a NAND-IMM instruction
+            printf("Wrong format of inputs at line %i\n", lineNumber);
+            printf("Inputs: %s\n", line);
+            exit(-1);
 
-    REG[rDest] = ~(REG[rOp1] & iOp2);
+        }
 
-    setFlags(REG[rDest]);
+        if(BATCH_JOB_COUNT == capacity) {
 
-    printf("NAND-IMM\n");
+            capacity = capacity ? capacity * 2 : 256;
+            BATCH_JOBS = realloc(BATCH_JOBS, capacity * sizeof(BatchJob));
 
-}
+        }
 
-void NOR_IMM(uint8_t rDest, uint8_t rOp1, uint16_t iOp2) {
-    // Executes A NOR-IMM instruction
+        BATCH_JOBS[BATCH_JOB_COUNT++] = (BatchJob) { .binfile = strdup(line) };
 
-    REG[rDest] = ~(REG[rOp1] | iOp2);
+    }
 
-    setFlags(REG[rDest]);
+    fclose(list);
 
-    printf("NOR-IMM\n");
+    if((uint32_t) workers > BATCH_JOB_COUNT) workers = BATCH_JOB_COUNT ? BATCH_JOB_COUNT : 1;
 
-}
+    WORKER_COUNT = workers;
+    WORK_QUEUES = malloc(workers * sizeof(WorkQueue));
 
-void LOAD(uint8_t rDest, uint8_t rBase, uint16_t iOffset) {
-    // Executes a LOAD instruction
+    for(int worker = 0; worker < workers; worker++) {
 
-    REG[rDest] = MEM[REG[rBase] + iOffset];
+        pthread_mutex_init(&WORK_QUEUES[worker].lock, NULL);
+        WORK_QUEUES[worker].head = (uint64_t) BATCH_JOB_COUNT * worker / workers;
+        WORK_QUEUES[worker].tail = (uint64_t) BATCH_JOB_COUNT * (worker + 1) / workers;
 
-    printf("LOAD\n");
+    }
 
-}
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-void STORE(uint8_t rSrc, uint8_t rBase, uint16_t iOffset) {
-    // Executes a STORE instruction
+    pthread_t* threads = malloc(workers * sizeof(pthread_t));
 
-    MEM[REG[rBase] + iOffset] = REG[rSrc];
+    for(intptr_t worker = 0; worker < workers; worker++) pthread_create(&threads[worker], NULL, batchWorker, (void*) worker);
+    for(int worker = 0; worker < workers; worker++) pthread_join(threads[worker], NULL);
 
-    printf("STORE\n");
+    clock_gettime(CLOCK_MONOTONIC, &end);
 
-}
+    uint32_t halted = 0;
 
-void JUMP(uint16_t destAddr) {
-    // Executes a JUMP instruction
+    for(uint32_t job = 0; job < BATCH_JOB_COUNT; job++) {
 
-    PC = destAddr;
+        BatchJob* j = &BATCH_JOBS[job];
 
-    printf("JUMP\n");
+        printf("%-20s PC = 0x%.4X  MEMORY checksum = 0x%.8X  %12llu steps  %10.3f ms  %s\n",
+            j->loaded ? STATUS_NAMES[j->status] : "load-failed", j->finalPC, j->checksum, (unsigned long long) j->steps,
+            j->runTime * 1000, j->binfile);
 
-}
+        if(DUMP_STATE && SWEEP_PARENT) {
+
+            for(int reg = 0; reg < 0x10; reg++) printf("R%i = 0x%.4X%s", reg, j->registers[reg], reg % 8 == 7 ? "\n" : "  ");
+
+        }
 
-void JUMP_IF_ZERO(uint16_t destAddr) {
-    // Executes a JUMP-IF-ZERO instruction
+        if(j->loaded && j->status == SMIS_STATUS_HALTED) halted++;
 
-    if(ZF) PC = destAddr;
+    }
 
-    printf("JUMP-IF-ZERO\n");
+    printf("%u %s, %u halted, %u failed, %.3f s on %i threads\n", BATCH_JOB_COUNT, SWEEP_PARENT ? "inputs" : "programs", halted, BATCH_JOB_COUNT - halted,
+        (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9, workers);
 
 }
 
-void JUMP_IF_NOTZERO(uint16_t destAddr) {
-    // Executes a JUMP-IF-NOTZERO instruction
+void* batchWorker(void* arg) {
+    // Runs jobs on one machine, which is reset (or forked again) between jobs instead of being reallocated
 
-    if(!ZF) PC = destAddr;
+    int worker = (intptr_t) arg;
 
-    printf("JUMP-IF-NOTZERO\n");
+    SmisMachine* m = createMachine();
 
-}
+    uint32_t job;
 
-void JUMP_LINK(uint16_t destAddr) {
-    // Executes a JUMP-LINK instruction
+    while(takeJob(worker, &job)) runBatchJob(m, &BATCH_JOBS[job]);
 
-    RLR = PC;
-    PC = destAddr;
+    smisDestroy(m);
 
-    printf("JUMP-LINK\n");
+    return NULL;
 
 }
 
-void HALT() {
-    // Executes a HALT instruction
+bool takeJob(int worker, uint32_t* job) {
+    // Takes the next job from a worker's own queue, or steals the back half of another worker's remaining jobs
+    // Returns false once no worker has any jobs left
 
-    printf("HALT\n");
+    WorkQueue* own = &WORK_QUEUES[worker];
 
-    exit(0);
+    pthread_mutex_lock(&own->lock);
 
-}
+    if(own->head < own->tail) {
 
-uint8_t getOpcode(uint32_t instruction) {
-    // Gets the opcode of a given instruction
+        *job = own->head++;
+        pthread_mutex_unlock(&own->lock);
+        return true;
 
-    return instruction >> 24;
+    }
 
-}
+    pthread_mutex_unlock(&own->lock);
+
+    for(int offset = 1; offset < WORKER_COUNT; offset++) {
+
+        WorkQueue* victim = &WORK_QUEUES[(worker + offset) % WORKER_COUNT];
+
+        pthread_mutex_lock(&victim->lock);
+
+        if(victim->head < victim->tail) {
+
+            uint32_t stolenTail = victim->tail;
+            uint32_t stolenHead = victim->tail - (victim->tail - victim->head + 1) / 2;
+
+            victim->tail = stolenHead;
+            pthread_mutex_unlock(&victim->lock);
 
-uint16_t getInstructionHalf1(uint32_t instruction) {
-    // Returns the 16 most significant bits of an instruction
+            pthread_mutex_lock(&own->lock);
+            own->head = stolenHead + 1;
+            own->tail = stolenTail;
+            pthread_mutex_unlock(&own->lock);
 
-    return (instruction & 0xFFFF0000) >> 16;
+            *job = stolenHead;
+            return true;
+
+        }
+
+        pthread_mutex_unlock(&victim->lock);
+
+    }
+
+    return false;
 
 }
 
-uint16_t getInstructionHalf2(uint32_t instruction) {
-    // Returns the 16 least significant bits of an instruction
+void runBatchJob(SmisMachine* m, BatchJob* job) {
+    // Loads and runs a single program of a batch, or forks the sweep program and runs it on one line of inputs,
+    // recording how it stopped
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if(SWEEP_PARENT) {
+
+        smisFork(m, SWEEP_PARENT);
+        job->loaded = setInputs(m, job->binfile);
 
-    return instruction & 0xFFFF;
+    } else job->loaded = loadProgram(m, job->binfile);
+
+    if(job->loaded) smisRun(m, 0);
+    else smisReset(m);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    job->status = smisGetStatus(m);
+    job->finalPC = smisGetPC(m);
+    job->steps = smisGetSteps(m);
+    job->checksum = smisMemoryChecksum(m);
+
+    for(int reg = 0; reg < 0x10; reg++) job->registers[reg] = smisGetRegister(m, reg);
+    job->runTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
 
 }
 
-uint8_t getRegOperand(uint32_t instruction, uint8_t opNum) {
-    // Gets the first operand of a given instruction
+bool setInputs(SmisMachine* m, char* inputs) {
+    // Sets the registers and memory words given by a line of sweep inputs, "R<n>=<value>" or "[<address>]=<value>"
+    // separated by spaces, values and addresses can be decimal or 0x-prefixed hex
+    // Returns false if the line is not in that format, only checking it if m is NULL
+
+    char* input = inputs;
+
+    while(*input) {
+
+        if(*input == ' ' || *input == '\t') {
 
-    opNum--;
+            input++;
+            continue;
 
-    if(opNum > 2) {
+        }
 
-        printf("Internal error: cannot retrieve register operand %i at instruction %i\n", opNum + 1, PC);
-        exit(-2);
+        bool isRegister = *input == 'R';
+        char* end;
+
+        if(*input != 'R' && *input != '[') return false;
+
+        unsigned long target = strtoul(input + 1, &end, isRegister ? 10 : 0);
+
+        if(end == input + 1 || target > (isRegister ? 0xF : 0xFFFF) || (!isRegister && *end++ != ']') || *end++ != '=') return false;
+
+        input = end;
+        unsigned long value = strtoul(input, &end, 0);
+
+        if(end == input || value > 0xFFFF || (*end && *end != ' ' && *end != '\t')) return false;
+
+        input = end;
+
+        if(!m) continue;
+
+        if(isRegister) smisSetRegister(m, target, value);
+        else smisWriteMemory(m, target, value);
 
     }
 
-    return (instruction & (0x00F00000 >> (4 * opNum))) >> (20 - (4 * opNum));
-    // TODO: There is probably a much nicer way to do this, but it works
+    return true;
 
 }
 
-uint16_t getDestOrImmVal(uint32_t instruction) {
-    // Gets the destination address of a J-Type instruction or immediate value of an I-Type instruction
+bool containsOnlyNums(char* str) {
+    // Checks if a given string contains only numerical digit characters
+
+    while(*str) {
 
-    return instruction & 0xFFFF;
+        if(*str < '0' || *str > '9') return false;
+        str++;
+
+    }
+
+    return true;
 
 }
 
@@ -800,4 +1221,4 @@ bool endsWith(char* str, char* substr) {
 
     return !strncmp(str, substr, MAX_STRING_LEN);
 
-}
\ No newline at end of file
+}
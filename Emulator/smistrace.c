@@ -0,0 +1,268 @@
+/*
+
+SMIS binary trace reader
+
+Converts the binary traces written by "smisem --trace-file=<file>" into text, one line per executed instruction
+in the same layout as "smisem --trace=2", with the instruction number in front and any memory write after the result.
+
+Program overview:
+
+    The trace is a sequence of chunks, each starting with a header that holds the number of the first instruction
+    in it, followed by one variable-length record per instruction (the format is described in libsmisem.h).
+    Chunks are read and decoded one at a time, and only the requested range of instructions is printed.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define USAGE "Usage: ./smistrace <input binary trace file> [<first instruction number> [<instruction count>]]\n"
+#define MAX_STRING_LEN 500
+#define CHUNK_SIZE 0x10000
+#define CHUNK_HEADER 16
+
+#define OP_SET              1
+#define OP_COPY             2
+
+#define OP_ADD              3
+#define OP_SUBTRACT         4
+#define OP_MULTIPLY         5
+#define OP_DIVIDE           6
+#define OP_MODULO           7
+
+#define OP_COMPARE          8
+
+#define OP_SHIFT_LEFT       9
+#define OP_SHIFT_RIGHT      10
+
+#define OP_AND              11
+#define OP_OR               12
+#define OP_XOR              13
+#define OP_NAND             14
+#define OP_NOR              15
+#define OP_NOT              16
+
+#define OP_ADD_IMM          17
+#define OP_SUBTRACT_IMM     18
+#define OP_MULTIPLY_IMM     19
+#define OP_DIVIDE_IMM       20
+#define OP_MODULO_IMM       21
+
+#define OP_COMPARE_IMM      22
+#define OP_SHIFT_LEFT_IMM   23
+#define OP_SHIFT_RIGHT_IMM  24
+#define OP_AND_IMM          25
+#define OP_OR_IMM           26
+#define OP_XOR_IMM          27
+#define OP_NAND_IMM         28
+#define OP_NOR_IMM          29
+
+#define OP_LOAD             30
+#define OP_STORE            31
+
+#define OP_JUMP             32
+#define OP_JUMP_IF_ZERO     33
+#define OP_JUMP_IF_NOTZERO  34
+#define OP_JUMP_LINK        35
+
+#define OP_HALT             36
+
+
+const char* MNEMONICS[] = {
+
+    [OP_SET] = "SET", [OP_COPY] = "COPY",
+    [OP_ADD] = "ADD", [OP_SUBTRACT] = "SUBTRACT", [OP_MULTIPLY] = "MULTIPLY",
+    [OP_DIVIDE] = "DIVIDE", [OP_MODULO] = "MODULO",
+    [OP_COMPARE] = "COMPARE",
+    [OP_SHIFT_LEFT] = "SHIFT-LEFT", [OP_SHIFT_RIGHT] = "SHIFT-RIGHT",
+    [OP_AND] = "AND", [OP_OR] = "OR", [OP_XOR] = "XOR",
+    [OP_NAND] = "NAND", [OP_NOR] = "NOR", [OP_NOT] = "NOT",
+    [OP_ADD_IMM] = "ADD-IMM", [OP_SUBTRACT_IMM] = "SUBTRACT-IMM", [OP_MULTIPLY_IMM] = "MULTIPLY-IMM",
+    [OP_DIVIDE_IMM] = "DIVIDE-IMM", [OP_MODULO_IMM] = "MODULO-IMM",
+    [OP_COMPARE_IMM] = "COMPARE-IMM",
+    [OP_SHIFT_LEFT_IMM] = "SHIFT-LEFT-IMM", [OP_SHIFT_RIGHT_IMM] = "SHIFT-RIGHT-IMM",
+    [OP_AND_IMM] = "AND-IMM", [OP_OR_IMM] = "OR-IMM", [OP_XOR_IMM] = "XOR-IMM",
+    [OP_NAND_IMM] = "NAND-IMM", [OP_NOR_IMM] = "NOR-IMM",
+    [OP_LOAD] = "LOAD", [OP_STORE] = "STORE",
+    [OP_JUMP] = "JUMP", [OP_JUMP_IF_ZERO] = "JUMP-IF-ZERO",
+    [OP_JUMP_IF_NOTZERO] = "JUMP-IF-NOTZERO", [OP_JUMP_LINK] = "JUMP-LINK",
+    [OP_HALT] = "HALT"
+
+};
+// Mnemonic names indexed by opcode
+
+
+uint64_t FIRST_STEP = 0;
+uint64_t STEP_COUNT = UINT64_MAX;
+// The range of instructions to print, by number of instructions executed before them
+
+
+bool readChunk(FILE* trace, uint8_t* chunk, uint32_t* size, uint64_t* firstStep);
+bool printChunk(uint8_t* chunk, uint32_t size, uint64_t step);
+// Program control functions
+
+uint32_t getTraceBytes(uint8_t* src, int count);
+bool containsOnlyNums(char* str);
+// General utility functions
+
+
+int main(int argc, char** argv) {
+
+    if(argc < 2 || argc > 4) {
+
+        printf("Incorrect number of arguments supplied.\n");
+        printf(USAGE);
+        exit(-1);
+
+    }
+
+    for(int arg = 2; arg < argc; arg++) {
+
+        if(!containsOnlyNums(argv[arg]) || !argv[arg][0]) {
+
+            printf("Argument %s is not a number.\n", argv[arg]);
+            printf(USAGE);
+            exit(-1);
+
+        }
+
+    }
+
+    if(argc > 2) FIRST_STEP = strtoull(argv[2], NULL, 10);
+    if(argc > 3) STEP_COUNT = strtoull(argv[3], NULL, 10);
+
+    FILE* trace;
+
+    if(!(trace = fopen(argv[1], "rb"))) {
+
+        printf("File %s does not exist.\n", argv[1]);
+        printf(USAGE);
+        exit(-1);
+
+    }
+
+    uint8_t* chunk = malloc(CHUNK_SIZE);
+    uint32_t size;
+    uint64_t firstStep;
+
+    while(readChunk(trace, chunk, &size, &firstStep)) {
+
+        if(!printChunk(chunk, size, firstStep)) break;
+
+    }
+
+    fclose(trace);
+    free(chunk);
+
+}
+
+bool readChunk(FILE* trace, uint8_t* chunk, uint32_t* size, uint64_t* firstStep) {
+    // Reads the next chunk of records from the trace
+    // Returns false at the end of the trace, and exits if the trace is damaged
+
+    uint8_t header[CHUNK_HEADER];
+
+    if(!fread(header, CHUNK_HEADER, 1, trace)) return false;
+
+    *size = getTraceBytes(header + 4, 4);
+    *firstStep = getTraceBytes(header + 8, 4) | (uint64_t) getTraceBytes(header + 12, 4) << 32;
+
+    if(memcmp(header, "SMTC", 4) || *size > CHUNK_SIZE - CHUNK_HEADER || fread(chunk, 1, *size, trace) != *size) {
+
+        printf("The trace is damaged or is not a binary SMIS trace.\n");
+        exit(-1);
+
+    }
+
+    return true;
+
+}
+
+bool printChunk(uint8_t* chunk, uint32_t size, uint64_t step) {
+    // Prints the records of one chunk that fall in the requested range
+    // Returns false once the end of the range has been reached
+
+    uint16_t pc = 0;
+
+    for(uint32_t offset = 0; offset < size; step++) {
+
+        uint8_t header = chunk[offset++];
+        uint32_t needed = (header & 0x01 ? 2 : 0) + 4 + (header & 0x02 ? 3 : 0) + (header & 0x04 ? 4 : 0);
+
+        if(offset + needed > size) {
+
+            printf("The trace is damaged or is not a binary SMIS trace.\n");
+            exit(-1);
+
+        }
+        // The fields that follow the record header must all be inside the chunk
+
+        if(header & 0x01) { pc = getTraceBytes(chunk + offset, 2); offset += 2; }
+
+        uint32_t instruction = getTraceBytes(chunk + offset, 4);
+        offset += 4;
+
+        uint8_t opcode = instruction ? instruction >> 24 : OP_HALT;
+        const char* mnemonic = opcode <= OP_HALT && MNEMONICS[opcode] ? MNEMONICS[opcode] : "(unknown)";
+
+        if(step - FIRST_STEP >= STEP_COUNT && step >= FIRST_STEP) return false;
+
+        bool print = step >= FIRST_STEP;
+
+        if(print) printf("%12llu  0x%.4X  0x%.8X  %-16s", (unsigned long long) step, pc, instruction, mnemonic);
+
+        if(header & 0x02) {
+
+            if(print && opcode == OP_JUMP_LINK) printf("RLR = %i  ", getTraceBytes(chunk + offset + 1, 2));
+            else if(print) printf("R%i = %i  ", chunk[offset], getTraceBytes(chunk + offset + 1, 2));
+            // The link register written by JUMP-LINK is shown as RLR, like --trace=2 does
+            offset += 3;
+
+        }
+
+        if(header & 0x04) {
+
+            if(print) printf("[0x%.4X] = %i  ", getTraceBytes(chunk + offset, 2), getTraceBytes(chunk + offset + 2, 2));
+            offset += 4;
+
+        }
+
+        if(print) printf("ZF = %i  SF = %i\n", (header & 0x08) != 0, (header & 0x10) != 0);
+
+        pc += 2;
+
+    }
+
+    return true;
+
+}
+
+uint32_t getTraceBytes(uint8_t* src, int count) {
+    // Reads a little-endian number of count bytes
+
+    uint32_t value = 0;
+
+    for(int i = count - 1; i >= 0; i--) value = value << 8 | src[i];
+
+    return value;
+
+}
+
+bool containsOnlyNums(char* str) {
+    // Checks if a given string contains only numerical digit characters
+
+    while(*str) {
+
+        if(*str < '0' || *str > '9') return false;
+        str++;
+
+    }
+
+    return true;
+
+}
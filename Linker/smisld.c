@@ -0,0 +1,508 @@
+/*
+
+SMIS ASM linker
+
+Documentation for the SMIS assembly language is hosted at https://github.com/Eyesonjune18/SMIS/blob/main/Documentation/SMIS.pdf
+
+Program overview:
+
+    The linker puts the relocatable .obj files written by smisasm together into one .bin executable, so that
+    a large program can be assembled one module at a time and only the modules that changed need to be
+    assembled again.
+
+    (Loading)
+        Each object file is read whole and checked. The modules are laid out one after another in the
+        order they are given, so the program starts at the first instruction of the first module.
+
+    (Exports)
+        Every label defined by a module is placed into a hash table of exported labels, at its address
+        moved up by the address its module starts at. A label defined by more than one module can still
+        be used inside each of those modules, but jumping to it from any other module is an error, since
+        it would not be clear which one is meant.
+
+    (Relocation)
+        Each relocation names an instruction and a symbol of its module. A symbol that the module defines
+        is its own label, and an imported symbol is the exported label of the same name. The address of
+        the label is written into the instruction. If no module defines an imported label, the program
+        cannot be linked.
+
+    (Output) The instructions of all modules are written to the .bin file at once. With --symbols, all
+        labels are also written to a .sym file next to the .bin file at their final addresses, in the same
+        format as smisasm --symbols.
+
+    The object file format is described in smisasm.c.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <arpa/inet.h>
+
+
+#define USAGE "Usage: ./smisld [--symbols] <input .obj object files> <output .bin executable file>\n"
+#define MAX_STRING_LEN 500
+#define MAX_INSTRUCTIONS 0x8000
+// Instructions are two words long, so this many fill the 16-bit address space
+
+#define OBJECT_MAGIC "SMOB"
+#define OBJECT_VERSION 1
+#define OBJECT_IMPORT 0xFFFFFFFF
+#define OBJECT_HEADER_WORDS 6
+
+#define EXPORT_INDEX_MIN_SLOTS 1024
+
+
+typedef struct Module {
+
+    char* objfile;
+    uint32_t* contents;
+
+    uint32_t* code;
+    uint32_t codeCount;
+    uint32_t* symbols;
+    uint32_t symbolCount;
+    // Pairs of name offset and address, the address is OBJECT_IMPORT for labels the module does not define
+    uint32_t* relocations;
+    uint32_t relocationCount;
+    // Pairs of instruction number and symbol number
+    char* names;
+    uint32_t nameBytes;
+
+    uint32_t firstInstruction;
+
+} Module;
+
+typedef struct Export {
+
+    char* name;
+    uint16_t PCAddress;
+    bool ambiguous;
+
+} Export;
+
+
+Module* MODULES = NULL;
+uint32_t MODULE_COUNT = 0;
+// Stores all modules in link order
+
+Export* EXPORTS = NULL;
+uint32_t EXPORT_COUNT = 0;
+uint32_t EXPORT_CAPACITY = 0;
+
+uint32_t* EXPORT_INDEX = NULL;
+uint32_t EXPORT_INDEX_SLOTS = 0;
+// Hash table of positions in EXPORTS plus 1, with 0 marking an empty slot
+
+uint32_t* PROGRAM = NULL;
+uint32_t PROGRAM_COUNT = 0;
+// Stores the instructions of all modules, in the byte order of this machine until they are written
+
+
+void readModule(char* objfile, Module* m);
+void layoutModules();
+void addExports();
+void relocateModules();
+void writeProgram(char* binfile);
+void writeSymbols(char* binfile);
+// Program control functions
+
+void addExport(char* name, uint16_t addr);
+int32_t findExport(char* name);
+void growExportIndex();
+uint32_t hashName(char* name);
+uint16_t getSymbolAddr(Module* m, uint32_t symbol);
+// Symbol table functions
+
+bool endsWith(char* str, char* substr);
+// General utility functions
+
+
+int main(int argc, char** argv) {
+
+    bool symbols = argc > 1 && !strncmp(argv[1], "--symbols", MAX_STRING_LEN);
+    int firstObject = symbols ? 2 : 1;
+
+    if(argc - firstObject < 2) {
+
+        printf("Incorrect number of arguments supplied.\n");
+        printf(USAGE);
+        exit(-1);
+
+    }
+
+    char* binfile = argv[argc - 1];
+
+    if(!endsWith(binfile, ".bin")) {
+
+        printf("The output file %s does not have the .bin extension.\n", binfile);
+        printf(USAGE);
+        exit(-1);
+
+    }
+
+    MODULE_COUNT = argc - 1 - firstObject;
+    MODULES = calloc(MODULE_COUNT, sizeof(Module));
+
+    for(uint32_t i = 0; i < MODULE_COUNT; i++) {
+
+        if(!endsWith(argv[firstObject + i], ".obj")) {
+
+            printf("The input file %s does not have the .obj extension.\n", argv[firstObject + i]);
+            printf(USAGE);
+            exit(-1);
+
+        }
+
+        readModule(argv[firstObject + i], &MODULES[i]);
+
+    }
+
+    layoutModules();
+    addExports();
+    relocateModules();
+    writeProgram(binfile);
+
+    if(symbols) writeSymbols(binfile);
+
+    for(uint32_t i = 0; i < MODULE_COUNT; i++) free(MODULES[i].contents);
+
+    free(MODULES);
+    free(EXPORTS);
+    free(EXPORT_INDEX);
+    free(PROGRAM);
+
+}
+
+void readModule(char* objfile, Module* m) {
+    // Reads a whole object file and checks that everything in it refers to something that exists
+
+    FILE* objFile;
+
+    if(!(objFile = fopen(objfile, "rb"))) {
+
+        printf("File %s does not exist.\n", objfile);
+        printf(USAGE);
+        exit(-1);
+
+    }
+
+    fseek(objFile, 0, SEEK_END);
+    long size = ftell(objFile);
+    fseek(objFile, 0, SEEK_SET);
+
+    uint32_t* contents = malloc(size + 1);
+
+    if(size < 0 || fread(contents, 1, size, objFile) != (size_t) size) {
+
+        printf("Cannot read file %s.\n", objfile);
+        exit(-1);
+
+    }
+
+    fclose(objFile);
+
+    if((size_t) size < OBJECT_HEADER_WORDS * sizeof(uint32_t) || memcmp(contents, OBJECT_MAGIC, 4)
+        || ntohl(contents[1]) != OBJECT_VERSION) {
+
+        printf("File %s is not a SMIS object file of version %i.\n", objfile, OBJECT_VERSION);
+        exit(-1);
+
+    }
+
+    for(long i = 1; i < size / (long) sizeof(uint32_t); i++) contents[i] = ntohl(contents[i]);
+    // Everything up to the names is a 32-bit number, the names themselves are turned back below
+
+    m->objfile = objfile;
+    m->contents = contents;
+    m->codeCount = contents[2];
+    m->symbolCount = contents[3];
+    m->relocationCount = contents[4];
+    m->nameBytes = contents[5];
+
+    uint64_t words = OBJECT_HEADER_WORDS + (uint64_t) m->codeCount + m->symbolCount * 2ULL + m->relocationCount * 2ULL;
+
+    if(words * sizeof(uint32_t) + m->nameBytes != (size_t) size) {
+
+        printf("Object file %s is damaged: its size does not match its header.\n", objfile);
+        exit(-1);
+
+    }
+
+    m->code = contents + OBJECT_HEADER_WORDS;
+    m->symbols = m->code + m->codeCount;
+    m->relocations = m->symbols + m->symbolCount * 2;
+    m->names = (char*) (m->relocations + m->relocationCount * 2);
+
+    for(long i = words; i < size / (long) sizeof(uint32_t); i++) contents[i] = htonl(contents[i]);
+
+    if(m->nameBytes && m->names[m->nameBytes - 1]) {
+
+        printf("Object file %s is damaged: its last name is not ended.\n", objfile);
+        exit(-1);
+
+    }
+
+    for(uint32_t i = 0; i < m->symbolCount; i++) {
+
+        if(m->symbols[i * 2] >= m->nameBytes) {
+
+            printf("Object file %s is damaged: symbol %u has no name.\n", objfile, i);
+            exit(-1);
+
+        }
+
+    }
+
+    for(uint32_t i = 0; i < m->relocationCount; i++) {
+
+        if(m->relocations[i * 2] >= m->codeCount || m->relocations[i * 2 + 1] >= m->symbolCount) {
+
+            printf("Object file %s is damaged: relocation %u is out of range.\n", objfile, i);
+            exit(-1);
+
+        }
+
+    }
+
+}
+
+void layoutModules() {
+    // Places the modules one after another and copies their instructions into the program
+
+    for(uint32_t i = 0; i < MODULE_COUNT; i++) {
+
+        MODULES[i].firstInstruction = PROGRAM_COUNT;
+        PROGRAM_COUNT += MODULES[i].codeCount;
+
+        if(PROGRAM_COUNT > MAX_INSTRUCTIONS) {
+
+            printf("The linked program is larger than the %i instructions that fit in the address space.\n", MAX_INSTRUCTIONS);
+            exit(-1);
+
+        }
+
+    }
+
+    PROGRAM = malloc(PROGRAM_COUNT * sizeof(uint32_t) + 1);
+
+    for(uint32_t i = 0; i < MODULE_COUNT; i++) {
+
+        memcpy(PROGRAM + MODULES[i].firstInstruction, MODULES[i].code, MODULES[i].codeCount * sizeof(uint32_t));
+
+    }
+
+}
+
+void addExports() {
+    // Places every label defined by any module into the table of exported labels
+
+    for(uint32_t i = 0; i < MODULE_COUNT; i++) {
+
+        Module* m = &MODULES[i];
+
+        for(uint32_t s = 0; s < m->symbolCount; s++) {
+
+            if(m->symbols[s * 2 + 1] != OBJECT_IMPORT) addExport(m->names + m->symbols[s * 2], getSymbolAddr(m, s));
+
+        }
+
+    }
+
+}
+
+void relocateModules() {
+    // Writes the final address of the label each jump refers to into the jump
+
+    for(uint32_t i = 0; i < MODULE_COUNT; i++) {
+
+        Module* m = &MODULES[i];
+
+        for(uint32_t r = 0; r < m->relocationCount; r++) {
+
+            uint32_t instruction = m->firstInstruction + m->relocations[r * 2];
+
+            PROGRAM[instruction] = (PROGRAM[instruction] & 0xFFFF0000) | getSymbolAddr(m, m->relocations[r * 2 + 1]);
+
+        }
+
+    }
+
+}
+
+void writeProgram(char* binfile) {
+    // Writes the instructions of all modules to the .bin file in one write
+
+    FILE* binFile;
+
+    if(!(binFile = fopen(binfile, "wb"))) {
+
+        printf("Cannot output to file %s.\n", binfile);
+        printf(USAGE);
+        exit(-1);
+
+    }
+
+    for(uint32_t i = 0; i < PROGRAM_COUNT; i++) PROGRAM[i] = htonl(PROGRAM[i]);
+
+    fwrite(PROGRAM, sizeof(uint32_t), PROGRAM_COUNT, binFile);
+
+    fclose(binFile);
+
+}
+
+void writeSymbols(char* binfile) {
+    // Writes every label defined by a module to a .sym file with the same name as the given .bin file
+
+    char symfile[MAX_STRING_LEN];
+    FILE* symFile;
+
+    snprintf(symfile, MAX_STRING_LEN, "%.*s.sym", (int) strnlen(binfile, MAX_STRING_LEN) - 4, binfile);
+
+    if(!(symFile = fopen(symfile, "w"))) {
+
+        printf("Cannot output to file %s.\n", symfile);
+        printf(USAGE);
+        exit(-1);
+
+    }
+
+    for(uint32_t i = 0; i < MODULE_COUNT; i++) {
+
+        Module* m = &MODULES[i];
+
+        for(uint32_t s = 0; s < m->symbolCount; s++) {
+
+            if(m->symbols[s * 2 + 1] != OBJECT_IMPORT) fprintf(symFile, "0x%.4X %s\n", getSymbolAddr(m, s), m->names + m->symbols[s * 2]);
+
+        }
+
+    }
+
+    fclose(symFile);
+
+}
+
+void addExport(char* name, uint16_t addr) {
+    // Adds a label to the table of exported labels, or marks it as ambiguous if another module already defines it
+
+    int32_t existing = findExport(name);
+
+    if(existing >= 0) {
+
+        EXPORTS[existing].ambiguous = true;
+        return;
+
+    }
+
+    if(EXPORT_COUNT == EXPORT_CAPACITY) {
+
+        EXPORT_CAPACITY = EXPORT_CAPACITY ? EXPORT_CAPACITY * 2 : EXPORT_INDEX_MIN_SLOTS / 2;
+        EXPORTS = realloc(EXPORTS, EXPORT_CAPACITY * sizeof(Export));
+
+    }
+
+    if((EXPORT_COUNT + 1) * 2 > EXPORT_INDEX_SLOTS) growExportIndex();
+
+    EXPORTS[EXPORT_COUNT] = (Export) { .name = name, .PCAddress = addr };
+
+    uint32_t slot = hashName(name) & (EXPORT_INDEX_SLOTS - 1);
+
+    while(EXPORT_INDEX[slot]) slot = (slot + 1) & (EXPORT_INDEX_SLOTS - 1);
+
+    EXPORT_INDEX[slot] = ++EXPORT_COUNT;
+
+}
+
+int32_t findExport(char* name) {
+    // Finds the position of an exported label, or returns -1 if no module defines it
+
+    if(!EXPORT_INDEX_SLOTS) return -1;
+
+    uint32_t slot = hashName(name) & (EXPORT_INDEX_SLOTS - 1);
+
+    while(EXPORT_INDEX[slot]) {
+
+        if(!strcmp(EXPORTS[EXPORT_INDEX[slot] - 1].name, name)) return EXPORT_INDEX[slot] - 1;
+
+        slot = (slot + 1) & (EXPORT_INDEX_SLOTS - 1);
+
+    }
+
+    return -1;
+
+}
+
+void growExportIndex() {
+    // Doubles the number of slots in the hash index (or creates it), and puts every exported label back in
+
+    EXPORT_INDEX_SLOTS = EXPORT_INDEX_SLOTS ? EXPORT_INDEX_SLOTS * 2 : EXPORT_INDEX_MIN_SLOTS;
+
+    free(EXPORT_INDEX);
+    EXPORT_INDEX = calloc(EXPORT_INDEX_SLOTS, sizeof(uint32_t));
+
+    for(uint32_t i = 0; i < EXPORT_COUNT; i++) {
+
+        uint32_t slot = hashName(EXPORTS[i].name) & (EXPORT_INDEX_SLOTS - 1);
+
+        while(EXPORT_INDEX[slot]) slot = (slot + 1) & (EXPORT_INDEX_SLOTS - 1);
+
+        EXPORT_INDEX[slot] = i + 1;
+
+    }
+
+}
+
+uint32_t hashName(char* name) {
+    // Gets the FNV-1a hash of a label name, the same hash smisasm uses
+
+    uint32_t hash = 0x811C9DC5;
+
+    while(*name) hash = (hash ^ (uint8_t) *name++) * 0x01000193;
+
+    return hash;
+
+}
+
+uint16_t getSymbolAddr(Module* m, uint32_t symbol) {
+    // Gets the final address of a symbol of a module, terminating the program if it is an import nobody defines
+
+    char* name = m->names + m->symbols[symbol * 2];
+    uint32_t addr = m->symbols[symbol * 2 + 1];
+
+    if(addr != OBJECT_IMPORT) return m->firstInstruction * 2 + addr;
+
+    int32_t export = findExport(name);
+
+    if(export < 0) {
+
+        printf("Cannot use label %s in %s because no module defines it\n", name, m->objfile);
+        exit(-1);
+
+    }
+
+    if(EXPORTS[export].ambiguous) {
+
+        printf("Cannot use label %s in %s because more than one module defines it\n", name, m->objfile);
+        exit(-1);
+
+    }
+
+    return EXPORTS[export].PCAddress;
+
+}
+
+bool endsWith(char* str, char* substr) {
+    // Checks if a given string ends with a given substring
+
+    int strlen = strnlen(str, MAX_STRING_LEN);
+    int substrlen = strnlen(substr, MAX_STRING_LEN);
+
+    str += (strlen - substrlen);
+
+    return !strncmp(str, substr, MAX_STRING_LEN);
+
+}